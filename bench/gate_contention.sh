@@ -0,0 +1,21 @@
+#!/bin/sh
+# Throughput (transactions per second) of concurrent gate creation, for
+# an increasing number of clients. Requires pgbench from PostgreSQL 9.6
+# or later, and a database in which the current user can create the
+# provsql extension.
+#
+# Usage: bench/gate_contention.sh [database] [duration in seconds]
+
+DB=${1:-provsql_bench}
+DURATION=${2:-30}
+DIR=$(dirname "$0")
+
+psql -q -v ON_ERROR_STOP=1 -d "$DB" -f "$DIR/gate_contention_setup.sql" > /dev/null || exit 1
+
+echo "clients tps"
+for clients in 1 2 4 8 16 32; do
+  tps=$(pgbench -n -c $clients -j $clients -T "$DURATION" \
+          -f "$DIR/gate_contention.sql" "$DB" |
+        sed -n 's/^tps = \([0-9.]*\).*/\1/p' | head -n 1)
+  echo "$clients $tps"
+done
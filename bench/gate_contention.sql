@@ -0,0 +1,6 @@
+-- One transaction of gate_contention.sh: a provenance-tracked insertion
+-- (creating an input gate) and a join creating a new times gate
+\set id random(1, 10000)
+\set other random(1, 10000)
+INSERT INTO bench_items VALUES (:id + 10000);
+SELECT i1.id, i2.id FROM bench_items i1, bench_items i2 WHERE i1.id = :id AND i2.id = :other;
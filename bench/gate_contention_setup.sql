@@ -0,0 +1,10 @@
+-- Setup for gate_contention.sh: a provenance-tracked table whose
+-- tokens are combined by the benchmark transactions
+CREATE EXTENSION IF NOT EXISTS "uuid-ossp";
+CREATE EXTENSION IF NOT EXISTS provsql;
+
+DROP TABLE IF EXISTS bench_items;
+CREATE TABLE bench_items(id int);
+INSERT INTO bench_items SELECT * FROM generate_series(1,10000);
+CREATE INDEX ON bench_items(id);
+SELECT provsql.add_provenance('bench_items');
@@ -27,14 +27,38 @@ CREATE INDEX ON provenance_circuit_extra (gate);
 CREATE INDEX ON provenance_circuit_wire (f);
 CREATE INDEX ON provenance_circuit_wire (t);
 
+CREATE FUNCTION create_gate(
+  token provenance_token,
+  type provenance_gate,
+  children uuid[] DEFAULT NULL)
+  RETURNS void AS
+  'provsql','create_gate' LANGUAGE C;
+REVOKE ALL ON FUNCTION create_gate(provenance_token, provenance_gate, uuid[]) FROM PUBLIC;
+
+CREATE FUNCTION get_gate_type(token provenance_token)
+  RETURNS provenance_gate AS
+  'provsql','get_gate_type' LANGUAGE C;
+
+CREATE FUNCTION get_children(token provenance_token)
+  RETURNS uuid[] AS
+  'provsql','get_children' LANGUAGE C;
+
+CREATE FUNCTION sub_circuit(token provenance_token)
+  RETURNS TABLE(f provenance_token, t UUID, gate_type provenance_gate) AS
+  'provsql','sub_circuit' LANGUAGE C STRICT;
+
+CREATE FUNCTION invalidate_circuit_cache()
+  RETURNS void AS
+  'provsql','invalidate_circuit_cache' LANGUAGE C;
+REVOKE ALL ON FUNCTION invalidate_circuit_cache() FROM PUBLIC;
+
 CREATE OR REPLACE FUNCTION add_provenance_circuit_gate_trigger()
   RETURNS TRIGGER AS
 $$
 DECLARE
   attribute RECORD;
 BEGIN
-  LOCK TABLE provenance_circuit_gate;
-  INSERT INTO provenance_circuit_gate VALUES (NEW.provsql, 'input'); 
+  PERFORM provsql.create_gate(NEW.provsql, 'input');
   RETURN NEW; 
 END
 $$ LANGUAGE plpgsql SET search_path=provsql,pg_temp SECURITY DEFINER;
@@ -44,8 +68,7 @@ CREATE OR REPLACE FUNCTION add_provenance(_tbl regclass)
 $$
 BEGIN
   EXECUTE format('ALTER TABLE %I ADD COLUMN provsql provsql.provenance_token UNIQUE DEFAULT uuid_generate_v4()', _tbl);
-  LOCK TABLE provenance_circuit_gate;
-  EXECUTE format('INSERT INTO provsql.provenance_circuit_gate SELECT provsql, ''input'' FROM %I',_tbl);
+  EXECUTE format('SELECT provsql.create_gate(provsql, ''input'') FROM %I',_tbl);
   EXECUTE format('CREATE TRIGGER add_provenance_circuit_gate BEFORE INSERT ON %I FOR EACH ROW EXECUTE PROCEDURE provsql.add_provenance_circuit_gate_trigger()',_tbl);
 --  EXECUTE format('ALTER TABLE %I ADD CONSTRAINT provsqlfk FOREIGN KEY (provsql) REFERENCES provsql.provenance_circuit_gate(gate)', _tbl);
 END
@@ -115,156 +138,23 @@ CREATE AGGREGATE uuid_provsql_agg(provenance_token) (
 
 CREATE FUNCTION provenance_times(VARIADIC tokens uuid[])
   RETURNS provenance_token AS
-$$
-DECLARE
-  times_token uuid;
---  ts timestamptz;
-BEGIN
---  ts := clock_timestamp();
-
-  CASE array_length(tokens,1)
-    WHEN 0 THEN
-      times_token:=gate_one();
-    WHEN 1 THEN
-      times_token:=tokens[1];
-    ELSE
-      SELECT uuid_generate_v5(uuid_ns_provsql(),concat('times',uuid_provsql_agg(t)))
-      INTO times_token
-      FROM unnest(tokens) t;
-
-      LOCK TABLE provenance_circuit_gate;
-      BEGIN
-        INSERT INTO provenance_circuit_gate VALUES(times_token,'times');
-        INSERT INTO provenance_circuit_wire SELECT times_token, t, row_number() OVER ()
-          FROM unnest(tokens) t;
-      EXCEPTION WHEN unique_violation THEN
-      END;
-  END CASE;
-  
---  raise notice 'times time spent=%', clock_timestamp() - ts;
-  RETURN times_token;
-END
-$$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER;
+  'provsql','provenance_times' LANGUAGE C SECURITY DEFINER;
 
 CREATE FUNCTION provenance_monus(token1 provenance_token, token2 provenance_token)
   RETURNS provenance_token AS
-$$
-DECLARE
-  monus_token uuid;
-  monusl_token uuid;
-  monusr_token uuid;
-BEGIN
-  IF token2 IS NULL THEN
-    -- Special semantics, because of a LEFT OUTER JOIN used by the
-    -- difference operator: token2 NULL means there is no second argument
-    RETURN token1;
-  END IF;
-
-  IF token1 = token2 THEN
-    -- X-X=0
-    monus_token:=gate_zero();
-  ELSIF token1 = gate_zero() THEN
-    -- 0-X=0
-    monus_token:=gate_zero();
-  ELSIF token2 = gate_zero() THEN
-    -- X-0=X
-    monus_token:=token1;
-  ELSE  
-    monus_token:=uuid_generate_v5(uuid_ns_provsql(),concat('monus',token1,token2));
-    monusl_token:=uuid_generate_v5(uuid_ns_provsql(),concat('monusl',token1,token2));
-    monusr_token:=uuid_generate_v5(uuid_ns_provsql(),concat('monusr',token1,token2));
-    LOCK TABLE provenance_circuit_gate;
-    BEGIN
-      INSERT INTO provenance_circuit_gate VALUES(monus_token,'monus');
-      INSERT INTO provenance_circuit_gate VALUES(monusl_token,'monusl');
-      INSERT INTO provenance_circuit_gate VALUES(monusr_token,'monusr');
-      INSERT INTO provenance_circuit_wire VALUES(monus_token,monusl_token);
-      INSERT INTO provenance_circuit_wire VALUES(monus_token,monusr_token);
-      INSERT INTO provenance_circuit_wire VALUES(monusl_token,token1);
-      INSERT INTO provenance_circuit_wire VALUES(monusr_token,token2);
-    EXCEPTION WHEN unique_violation THEN
-    END;
-  END IF;  
-
-  RETURN monus_token;
-END
-$$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER;
+  'provsql','provenance_monus' LANGUAGE C SECURITY DEFINER;
 
 CREATE FUNCTION provenance_project(token provenance_token, VARIADIC positions int[])
   RETURNS provenance_token AS
-$$
-DECLARE
-  project_token uuid;
-BEGIN
-  project_token:=uuid_generate_v5(uuid_ns_provsql(),concat(token,positions));
-  BEGIN
-    LOCK TABLE provenance_circuit_gate;
-    INSERT INTO provenance_circuit_gate VALUES(project_token,'project');
-    INSERT INTO provenance_circuit_wire VALUES(project_token,token);
-    INSERT INTO provenance_circuit_extra 
-      SELECT gate, case when info=0 then null else info end, row_number() over()
-      FROM (
-             SELECT project_token gate, unnest(positions) info
-           )t; 
-  EXCEPTION WHEN unique_violation THEN
-  END;
-  RETURN project_token;
-END
-$$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER;
+  'provsql','provenance_project' LANGUAGE C SECURITY DEFINER;
 
 CREATE FUNCTION provenance_eq(token provenance_token, pos1 int, pos2 int)
   RETURNS provenance_token AS
-$$
-DECLARE
-  eq_token uuid;
-BEGIN
-  eq_token:=uuid_generate_v5(uuid_ns_provsql(),concat(token,pos1,pos2));
-  LOCK TABLE provenance_circuit_gate;
-  BEGIN
-    INSERT INTO provenance_circuit_gate VALUES(eq_token,'eq');
-    INSERT INTO provenance_circuit_wire VALUES(eq_token, token);
-    INSERT INTO provenance_circuit_extra SELECT eq_token, pos1, pos2;
-  EXCEPTION WHEN unique_violation THEN
-  END;
-  RETURN eq_token;
-END
-$$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER; 
+  'provsql','provenance_eq' LANGUAGE C SECURITY DEFINER;
 
 CREATE OR REPLACE FUNCTION provenance_plus(tokens uuid[])
   RETURNS provenance_token AS
-$$
-DECLARE
-  c INTEGER;
-  plus_token uuid;
---  ts timestamptz;
-BEGIN
---  ts := clock_timestamp();
-  c:=array_length(tokens, 1);
-
-  IF c = 0 THEN
-    plus_token := gate_zero();
-  ELSIF c = 1 THEN
-    plus_token := tokens[1];
-  ELSE
-    plus_token := uuid_generate_v5(
-      uuid_ns_provsql(),
-      concat('plus',array_to_string(tokens, ',')));
-
-    LOCK TABLE provenance_circuit_gate;
-    BEGIN
-      INSERT INTO provenance_circuit_gate VALUES(plus_token,'plus');
-      INSERT INTO provenance_circuit_wire
-        SELECT plus_token, t 
-        FROM unnest(tokens) AS t
-        WHERE t != gate_zero();
-    EXCEPTION WHEN unique_violation THEN
-    END;
-  END IF;
-
---  raise notice 'plus time spent=%', clock_timestamp() - ts;
-  RETURN plus_token;
-END
-$$ LANGUAGE plpgsql STRICT SET search_path=provsql,pg_temp,public SECURITY DEFINER;
+  'provsql','provenance_plus' LANGUAGE C STRICT SECURITY DEFINER;
 
 CREATE OR REPLACE FUNCTION trim_circuit()
   RETURNS void AS
@@ -273,7 +163,11 @@ DECLARE
   attribute record;
   statement varchar;
 BEGIN
+  IF current_setting('provsql.circuit_storage')='shared_memory' THEN
+    RAISE EXCEPTION USING MESSAGE='trim_circuit is not supported with shared-memory circuit storage';
+  END IF;
   LOCK TABLE provenance_circuit_gate;
+  PERFORM provsql.invalidate_circuit_cache();
   FOR attribute IN
     SELECT attname, relname
     FROM pg_attribute JOIN pg_type ON atttypid=pg_type.oid JOIN pg_namespace ns1 ON typnamespace=ns1.oid
@@ -315,44 +209,44 @@ CREATE OR REPLACE FUNCTION provenance_evaluate(
   RETURNS anyelement AS
 $$
 DECLARE
-  rec record;
+  gate_type provsql.provenance_gate;
   result ALIAS FOR $0;
 BEGIN
-  SELECT gate_type INTO rec FROM provsql.provenance_circuit_gate WHERE gate = token;
+  gate_type:=provsql.get_gate_type(token);
   
-  IF rec IS NULL THEN
+  IF gate_type IS NULL THEN
     RETURN NULL;
-  ELSIF rec.gate_type='input' THEN
+  ELSIF gate_type='input' THEN
     EXECUTE format('SELECT * FROM %I WHERE provenance=%L',token2value,token) INTO result;
     IF result IS NULL THEN
       result:=element_one;
     END IF;
-  ELSIF rec.gate_type='plus' THEN
-    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L)) FROM provsql.provenance_circuit_wire WHERE f=%L',
+  ELSIF gate_type='plus' THEN
+    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L)) FROM unnest(provsql.get_children(%L)) AS t',
       plus_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token)
     INTO result;
-  ELSIF rec.gate_type='times' THEN
-    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L)) FROM provsql.provenance_circuit_wire WHERE f=%L',
+  ELSIF gate_type='times' THEN
+    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L)) FROM unnest(provsql.get_children(%L)) AS t',
       times_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token)
     INTO result;
-  ELSIF rec.gate_type='monus' THEN
+  ELSIF gate_type='monus' THEN
     IF monus_function IS NULL THEN
       RAISE EXCEPTION USING MESSAGE='Provenance with negation evaluated over a semiring without monus function';
     ELSE
-      EXECUTE format('SELECT %I(a[1],a[2]) FROM (SELECT array_agg(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L)) AS a FROM (SELECT w2.t FROM provsql.provenance_circuit_wire w1, provsql.provenance_circuit_wire w2, provsql.provenance_circuit_gate g WHERE w1.f=%L AND w1.t=w2.f AND w1.t=g.gate and g.gate_type=''monusl'' UNION ALL SELECT w2.t FROM provsql.provenance_circuit_wire w1, provsql.provenance_circuit_wire w2, provsql.provenance_circuit_gate g WHERE w1.f=%L AND w1.t=w2.f AND w1.t=g.gate and g.gate_type=''monusr'') t1) t2',
-        monus_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token,token)
+      EXECUTE format('SELECT %I(a[1],a[2]) FROM (SELECT array_agg(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L) ORDER BY r) AS a FROM (SELECT (provsql.get_children(c))[1] AS t, provsql.get_gate_type(c)=''monusr'' AS r FROM unnest(provsql.get_children(%L)) AS c) t1) t2',
+        monus_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token)
       INTO result;
     END IF;
-  ELSIF rec.gate_type='eq' THEN
-    EXECUTE format('SELECT provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L) FROM provsql.provenance_circuit_wire WHERE f=%L',
+  ELSIF gate_type='eq' THEN
+    EXECUTE format('SELECT provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L) FROM unnest(provsql.get_children(%L)) AS t',
       token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token)
     INTO result;
-  ELSIF rec.gate_type='zero' THEN
+  ELSIF gate_type='zero' THEN
     EXECUTE format('SELECT %I(a) FROM (SELECT %L::%I AS a WHERE FALSE) temp',plus_function,element_one,value_type) INTO result;
-  ELSIF rec.gate_type='one' THEN
+  ELSIF gate_type='one' THEN
     EXECUTE format('SELECT %L::%I',element_one,value_type) INTO result;
-  ELSIF rec.gate_type='project' THEN
-    EXECUTE format('SELECT provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L) FROM provsql.provenance_circuit_wire WHERE f=%L',
+  ELSIF gate_type='project' THEN
+    EXECUTE format('SELECT provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L) FROM unnest(provsql.get_children(%L)) AS t',
       token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,token)
     INTO result;
   ELSE
@@ -362,55 +256,6 @@ BEGIN
 END
 $$ LANGUAGE plpgsql;
 
-CREATE TYPE gate_with_prob AS (f UUID, t UUID, gate_type provenance_gate, prob DOUBLE PRECISION);
-CREATE TYPE gate_with_desc AS (f UUID, t UUID, gate_type provenance_gate, desc_str CHARACTER VARYING, infos INTEGER[]);
-
-CREATE OR REPLACE FUNCTION sub_circuit_with_prob(
-  token provenance_token,
-  token2prob regclass) RETURNS SETOF gate_with_prob AS
-$$
-BEGIN
-  RETURN QUERY EXECUTE
-      'WITH RECURSIVE transitive_closure(f,t,gate_type) AS (
-        SELECT f,t,gate_type FROM provsql.provenance_circuit_wire JOIN provsql.provenance_circuit_gate ON gate=f WHERE f=$1
-          UNION ALL
-        SELECT DISTINCT p2.f,p2.t,p3.gate_type FROM transitive_closure p1 JOIN provsql.provenance_circuit_wire p2 ON p1.t=p2.f JOIN provsql.provenance_circuit_gate p3 ON gate=p2.f
-      ) SELECT f::uuid, t::uuid, gate_type, NULL FROM transitive_closure
-        UNION
-        SELECT p2.provenance, NULL, ''input'', p2.value AS prob FROM transitive_closure p1 JOIN ' || token2prob ||' AS p2 ON provenance=t
-        UNION
-        SELECT provenance, NULL, ''input'', value AS prob FROM ' || token2prob || ' WHERE provenance=$1'
-  USING token;
-END  
-$$ LANGUAGE plpgsql;
-
-CREATE OR REPLACE FUNCTION sub_circuit_with_desc(
-  token provenance_token,
-  token2desc regclass) RETURNS SETOF gate_with_desc AS
-$$
-BEGIN
-  RETURN QUERY EXECUTE
-    'WITH RECURSIVE transitive_closure(f,t,gate_type) AS (
-      SELECT f,t,gate_type FROM provsql.provenance_circuit_wire JOIN provsql.provenance_circuit_gate ON gate=f WHERE f=$1
-      UNION ALL
-      SELECT DISTINCT p2.f,p2.t,p3.gate_type FROM transitive_closure p1 JOIN provsql.provenance_circuit_wire p2 ON p1.t=p2.f
-      JOIN provsql.provenance_circuit_gate p3 ON gate=p2.f )
-    SELECT t1.*, infos FROM (
-      SELECT f::uuid,t::uuid,gate_type,NULL FROM transitive_closure
-      UNION ALL
-      SELECT p2.provenance::uuid as f, NULL::uuid, ''input'', CAST (p2.value AS varchar) FROM transitive_closure p1 JOIN ' || token2desc || ' AS p2 
-        ON p2.provenance=t
-      UNION ALL
-      SELECT provenance::uuid as f, NULL::uuid, ''input'', CAST (value AS varchar) FROM ' || token2desc || ' WHERE provenance=$1 
-    ) t1
-    LEFT OUTER JOIN (
-      SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provsql.provenance_circuit_extra GROUP BY gate
-    ) t2 on t1.f=t2.gate'
-  USING token LOOP;
-  RETURN;
-END  
-$$ LANGUAGE plpgsql;
-
 CREATE OR REPLACE FUNCTION identify_token(
   token provenance_token, OUT table_name regclass, OUT nb_columns integer) AS
 $$
@@ -442,41 +287,61 @@ BEGIN
 END
 $$ LANGUAGE plpgsql STRICT;
 
-CREATE OR REPLACE FUNCTION sub_circuit_for_where(token provenance_token)
-  RETURNS TABLE(f provenance_token, t UUID, gate_type provenance_gate, table_name REGCLASS, nb_columns INTEGER, infos INTEGER[], tuple_no BIGINT) AS
-$$
-    WITH RECURSIVE transitive_closure(f,t,idx,gate_type) AS (
-      SELECT f,t,idx,gate_type FROM provsql.provenance_circuit_wire JOIN provsql.provenance_circuit_gate ON gate=f WHERE f=$1
-        UNION ALL
-      SELECT DISTINCT p2.*,p3.gate_type FROM transitive_closure p1 JOIN provsql.provenance_circuit_wire p2 ON p1.t=p2.f JOIN provsql.provenance_circuit_gate p3 ON gate=p2.f
-    ) SELECT t1.f, t1.t, t1.gate_type, table_name, nb_columns, infos, row_number() over() FROM (
-      SELECT f, t::uuid, idx, gate_type, NULL AS table_name, NULL AS nb_columns FROM transitive_closure
-      UNION ALL
-        SELECT DISTINCT t, NULL::uuid, NULL::int, 'input'::provenance_gate, (id).table_name, (id).nb_columns FROM transitive_closure JOIN (SELECT t AS prov, provsql.identify_token(t) as id FROM transitive_closure WHERE t NOT IN (SELECT f FROM transitive_closure)) temp ON t=prov
-      UNION ALL
-        SELECT DISTINCT $1, NULL::uuid, NULL::int, 'input'::provenance_gate, (id).table_name, (id).nb_columns FROM (SELECT provsql.identify_token($1) AS id WHERE $1 NOT IN (SELECT f FROM transitive_closure)) temp
-      ) t1 LEFT OUTER JOIN (
-      SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provenance_circuit_extra GROUP BY gate
-    ) t2 ON t1.f=t2.gate ORDER BY f,idx
-$$
-LANGUAGE sql;
+-- Former interfaces to sub-circuits, kept for compatibility on top of
+-- sub_circuit: leaves are typed as inputs, whatever their actual type,
+-- and extra information is read from provenance_circuit_extra
+CREATE TYPE gate_with_prob AS (f UUID, t UUID, gate_type provenance_gate, prob DOUBLE PRECISION);
+CREATE TYPE gate_with_desc AS (f UUID, t UUID, gate_type provenance_gate, desc_str CHARACTER VARYING, infos INTEGER[]);
 
-CREATE OR REPLACE FUNCTION sub_circuit(token provenance_token)
-  RETURNS TABLE(f provenance_token, t UUID, gate_type provenance_gate) AS
+CREATE OR REPLACE FUNCTION sub_circuit_with_prob(
+  token provenance_token,
+  token2prob regclass) RETURNS SETOF gate_with_prob AS
 $$
-    WITH RECURSIVE transitive_closure(f,t,gate_type) AS (
-      SELECT f,t,gate_type FROM provsql.provenance_circuit_wire JOIN provsql.provenance_circuit_gate ON gate=f WHERE f=$1
-        UNION ALL
-      SELECT DISTINCT p2.f, p2.t, p3.gate_type FROM transitive_closure p1 JOIN provsql.provenance_circuit_wire p2 ON p1.t=p2.f JOIN provsql.provenance_circuit_gate p3 ON gate=p2.f
-    ) 
-      SELECT f, t::uuid, gate_type FROM transitive_closure
-      UNION ALL
-        SELECT DISTINCT t, NULL::uuid, 'input'::provenance_gate FROM transitive_closure WHERE t NOT IN (SELECT f FROM transitive_closure)
-      UNION ALL
-        SELECT DISTINCT $1, NULL::uuid, 'input'::provenance_gate
+BEGIN
+  RETURN QUERY EXECUTE format(
+    'SELECT f::uuid, t, gate_type, NULL::double precision FROM provsql.sub_circuit($1) WHERE t IS NOT NULL
+       UNION ALL
+     SELECT s.f::uuid, NULL::uuid, ''input'', p.value::double precision
+     FROM provsql.sub_circuit($1) s JOIN %s p ON p.provenance=s.f WHERE s.t IS NULL',
+    token2prob)
+  USING token;
+END
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION sub_circuit_with_desc(
+  token provenance_token,
+  token2desc regclass) RETURNS SETOF gate_with_desc AS
 $$
-LANGUAGE sql;
+BEGIN
+  RETURN QUERY EXECUTE format(
+    'SELECT t1.*, infos FROM (
+       SELECT f::uuid, t, gate_type, NULL::varchar AS desc_str FROM provsql.sub_circuit($1) WHERE t IS NOT NULL
+         UNION ALL
+       SELECT s.f::uuid, NULL::uuid, ''input'', CAST(p.value AS varchar)
+       FROM provsql.sub_circuit($1) s JOIN %s p ON p.provenance=s.f WHERE s.t IS NULL
+     ) t1 LEFT OUTER JOIN (
+       SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provsql.provenance_circuit_extra GROUP BY gate
+     ) t2 ON t1.f=t2.gate',
+    token2desc)
+  USING token;
+END
+$$ LANGUAGE plpgsql;
 
+CREATE OR REPLACE FUNCTION sub_circuit_for_where(token provenance_token)
+  RETURNS TABLE(f provenance_token, t UUID, gate_type provenance_gate, table_name REGCLASS, nb_columns INTEGER, infos INTEGER[], tuple_no BIGINT) AS
+$$
+  SELECT s.f, s.t,
+    CASE WHEN s.t IS NULL THEN 'input' ELSE s.gate_type END,
+    id.table_name, id.nb_columns, infos, row_number() OVER (ORDER BY s.f, s.n)
+  FROM provsql.sub_circuit($1) WITH ORDINALITY AS s(f, t, gate_type, n)
+    LEFT OUTER JOIN LATERAL (
+      SELECT * FROM provsql.identify_token(s.f) WHERE s.t IS NULL
+    ) id ON true
+    LEFT OUTER JOIN (
+      SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provsql.provenance_circuit_extra GROUP BY gate
+    ) e ON s.f=e.gate
+  ORDER BY s.f, s.n
+$$ LANGUAGE sql;
 
 CREATE OR REPLACE FUNCTION provenance_evaluate(
   token provenance_token,
@@ -496,6 +361,26 @@ CREATE OR REPLACE FUNCTION probability_evaluate(
   RETURNS DOUBLE PRECISION AS
   'provsql','probability_evaluate' LANGUAGE C;
 
+CREATE OR REPLACE FUNCTION probability_evaluate_batch(
+  tokens uuid[],
+  token2probability regclass,
+  method text,
+  arguments text = NULL)
+  RETURNS TABLE(token provenance_token, probability DOUBLE PRECISION) AS
+  'provsql','probability_evaluate_batch' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION circuit_stats(
+  token provenance_token,
+  token2probability regclass = NULL,
+  OUT gates bigint,
+  OUT inputs bigint,
+  OUT depth int,
+  OUT dnf boolean,
+  OUT read_once DOUBLE PRECISION,
+  OUT treewidth int,
+  OUT method text) AS
+  'provsql','circuit_stats' LANGUAGE C;
+
 CREATE OR REPLACE FUNCTION view_circuit(
   token provenance_token,
   token2desc regclass,
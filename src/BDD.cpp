@@ -0,0 +1,306 @@
+#include "BDD.h"
+#include "Circuit.h"
+
+extern "C" {
+#include "provsql_utils.h"
+}
+
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+constexpr unsigned BDD::ZERO;
+constexpr unsigned BDD::ONE;
+constexpr unsigned BDD::TERMINAL;
+
+BDD::BDD(unsigned nb_vars, size_t mn, size_t mm) :
+  nodes({{TERMINAL, ZERO, ZERO, 0}, {TERMINAL, ONE, ONE, 0}}),
+  unique(nb_vars), level(nb_vars), var_at(nb_vars), count(0),
+  max_nodes(mn), max_memory(mm)
+{
+  for(unsigned v=0; v<nb_vars; ++v)
+    level[v] = var_at[v] = v;
+}
+
+unsigned BDD::levelOf(unsigned f) const
+{
+  return f <= ONE ? var_at.size() : level[nodes[f].var];
+}
+
+size_t BDD::memory() const
+{
+  // Approximation of the memory used by the nodes of a hash table
+  const size_t entry = sizeof(pair<uint64_t, unsigned>) + 2*sizeof(void*);
+
+  size_t result = nodes.capacity()*sizeof(Node) + free_nodes.capacity()*sizeof(unsigned);
+  for(const auto &u : unique)
+    result += u.size()*entry + u.bucket_count()*sizeof(void*);
+  for(const auto &c : computed)
+    result += c.size()*entry + c.bucket_count()*sizeof(void*);
+
+  return result;
+}
+
+void BDD::checkLimits() const
+{
+  if(count > max_nodes)
+    throw CircuitException("BDD larger than "+to_string(max_nodes)+" nodes");
+  if(count % 1024 == 0 && memory() > max_memory)
+    throw CircuitException("BDD larger than "+to_string(max_memory/1024)+" kB");
+}
+
+unsigned BDD::mk(unsigned var, unsigned lo, unsigned hi)
+{
+  if(lo == hi)
+    return lo;
+
+  auto &u = unique[var];
+  auto it = u.find(key(lo, hi));
+  if(it != u.end())
+    return it->second;
+
+  unsigned f;
+  if(free_nodes.empty()) {
+    f = nodes.size();
+    nodes.push_back({var, lo, hi, 0});
+  } else {
+    f = free_nodes.back();
+    free_nodes.pop_back();
+    nodes[f] = {var, lo, hi, 0};
+  }
+  ref(lo);
+  ref(hi);
+  u[key(lo, hi)] = f;
+  ++count;
+  checkLimits();
+
+  return f;
+}
+
+unsigned BDD::variable(unsigned var)
+{
+  return mk(var, ZERO, ONE);
+}
+
+unsigned BDD::apply(Op op, unsigned f, unsigned g)
+{
+  if(op == Op::AND) {
+    if(f == ZERO || g == ZERO)
+      return ZERO;
+    if(f == ONE || f == g)
+      return g;
+    if(g == ONE)
+      return f;
+  } else {
+    if(f == ONE || g == ONE)
+      return ONE;
+    if(f == ZERO || f == g)
+      return g;
+    if(g == ZERO)
+      return f;
+  }
+
+  if(f > g)
+    swap(f, g);
+
+  auto &cache = computed[static_cast<unsigned>(op)];
+  auto it = cache.find(key(f, g));
+  if(it != cache.end())
+    return it->second;
+
+  const unsigned l = min(levelOf(f), levelOf(g));
+  const bool fl = levelOf(f) == l, gl = levelOf(g) == l;
+  const unsigned f0 = fl ? nodes[f].lo : f, f1 = fl ? nodes[f].hi : f;
+  const unsigned g0 = gl ? nodes[g].lo : g, g1 = gl ? nodes[g].hi : g;
+
+  const unsigned lo = apply(op, f0, g0);
+  const unsigned hi = apply(op, f1, g1);
+  const unsigned result = mk(var_at[l], lo, hi);
+
+  computed[static_cast<unsigned>(op)][key(f, g)] = result;
+  return result;
+}
+
+unsigned BDD::negate(unsigned f)
+{
+  if(f <= ONE)
+    return ONE - f;
+
+  auto &cache = computed[2];
+  auto it = cache.find(key(f, 0));
+  if(it != cache.end())
+    return it->second;
+
+  const unsigned var = nodes[f].var, f0 = nodes[f].lo, f1 = nodes[f].hi;
+  const unsigned lo = negate(f0);
+  const unsigned hi = negate(f1);
+  const unsigned result = mk(var, lo, hi);
+
+  computed[2][key(f, 0)] = result;
+  return result;
+}
+
+void BDD::ref(unsigned f)
+{
+  if(f > ONE)
+    ++nodes[f].ref;
+}
+
+void BDD::deref(unsigned f)
+{
+  if(f > ONE)
+    --nodes[f].ref;
+}
+
+// Frees the dead nodes of a variable; their children, at lower levels,
+// may become dead in turn
+void BDD::freeDead(unsigned var)
+{
+  auto &u = unique[var];
+  for(auto it = u.begin(); it != u.end(); ) {
+    const unsigned f = it->second;
+    if(nodes[f].ref > 0) {
+      ++it;
+      continue;
+    }
+
+    deref(nodes[f].lo);
+    deref(nodes[f].hi);
+    free_nodes.push_back(f);
+    --count;
+    it = u.erase(it);
+  }
+}
+
+void BDD::collectGarbage()
+{
+  for(auto &c : computed)
+    c.clear();
+
+  for(auto var : var_at)
+    freeDead(var);
+}
+
+// Swaps the variables x and y of levels i and i+1 in place: each node
+// of x that depends on y, x ? (y ? f11 : f10) : (y ? f01 : f00), becomes
+// the node y ? (x ? f11 : f01) : (x ? f10 : f00), so that all node
+// numbers keep representing the same functions. Nodes of y that are no
+// longer used are freed.
+void BDD::swapLevels(unsigned i)
+{
+  const unsigned x = var_at[i], y = var_at[i+1];
+
+  vector<unsigned> xs;
+  for(const auto &p : unique[x])
+    xs.push_back(p.second);
+
+  for(auto f : xs) {
+    const unsigned f0 = nodes[f].lo, f1 = nodes[f].hi;
+    const bool d0 = f0 > ONE && nodes[f0].var == y;
+    const bool d1 = f1 > ONE && nodes[f1].var == y;
+    if(!d0 && !d1)
+      continue;
+
+    const unsigned f00 = d0 ? nodes[f0].lo : f0, f01 = d0 ? nodes[f0].hi : f0;
+    const unsigned f10 = d1 ? nodes[f1].lo : f1, f11 = d1 ? nodes[f1].hi : f1;
+
+    unique[x].erase(key(f0, f1));
+    const unsigned lo = mk(x, f00, f10);
+    ref(lo);
+    const unsigned hi = mk(x, f01, f11);
+    ref(hi);
+    deref(f0);
+    deref(f1);
+
+    nodes[f].var = y;
+    nodes[f].lo = lo;
+    nodes[f].hi = hi;
+    unique[y][key(lo, hi)] = f;
+  }
+
+  var_at[i] = y;
+  var_at[i+1] = x;
+  level[y] = i;
+  level[x] = i+1;
+
+  freeDead(y);
+}
+
+// Moves var to the level, in the range reached before the diagram
+// doubles in size, that minimizes the size of the diagram
+void BDD::sift(unsigned var)
+{
+  const unsigned n = var_at.size();
+  size_t best_size = count;
+  unsigned best_level = level[var];
+
+  while(level[var] < n-1 && count <= 2*best_size) {
+    swapLevels(level[var]);
+    if(count < best_size) {
+      best_size = count;
+      best_level = level[var];
+    }
+  }
+
+  while(level[var] > 0 && count <= 2*best_size) {
+    swapLevels(level[var]-1);
+    if(count < best_size) {
+      best_size = count;
+      best_level = level[var];
+    }
+  }
+
+  while(level[var] < best_level)
+    swapLevels(level[var]);
+  while(level[var] > best_level)
+    swapLevels(level[var]-1);
+}
+
+// Sifting (Rudell, 1993), variables with the most nodes first
+void BDD::reorder()
+{
+  static const unsigned MAX_SIFTED = 1000;
+
+  collectGarbage();
+
+  vector<unsigned> vars(var_at);
+  sort(vars.begin(), vars.end(), [&](unsigned a, unsigned b) {
+    return unique[a].size() > unique[b].size();
+  });
+  if(vars.size() > MAX_SIFTED)
+    vars.resize(MAX_SIFTED);
+
+  for(auto var : vars) {
+    if(provsql_interrupted)
+      throw CircuitException("Interrupted");
+    sift(var);
+  }
+}
+
+double BDD::probability(unsigned f, const vector<double> &prob) const
+{
+  unordered_map<unsigned, double> p = {{ZERO, 0.}, {ONE, 1.}};
+  vector<unsigned> stack = {f};
+
+  while(!stack.empty()) {
+    const unsigned g = stack.back();
+    if(p.find(g) != p.end()) {
+      stack.pop_back();
+      continue;
+    }
+
+    const Node &n = nodes[g];
+    auto lo = p.find(n.lo), hi = p.find(n.hi);
+    if(lo == p.end())
+      stack.push_back(n.lo);
+    if(hi == p.end())
+      stack.push_back(n.hi);
+    if(lo != p.end() && hi != p.end()) {
+      p[g] = prob[n.var] * hi->second + (1 - prob[n.var]) * lo->second;
+      stack.pop_back();
+    }
+  }
+
+  return p[f];
+}
@@ -0,0 +1,73 @@
+#ifndef BDD_H
+#define BDD_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/* Reduced ordered binary decision diagrams, without complement edges.
+ * Nodes are designated by their number, 0 and 1 being the terminals;
+ * each variable has its own unique table, so that two adjacent levels
+ * can be swapped in place for sifting-based reordering. Nodes are
+ * reference-counted: a node of reference count 0 is dead, but stays in
+ * the unique table (and can be revived) until collectGarbage is called.
+ * Results of apply are only protected once referenced with ref, and
+ * collectGarbage and reorder must not be called while unreferenced
+ * results are still in use. An exception is thrown when the number of
+ * nodes or the memory used exceed the given limits. */
+class BDD {
+ public:
+  static constexpr unsigned ZERO = 0;
+  static constexpr unsigned ONE = 1;
+  enum class Op : unsigned char { AND, OR };
+
+ private:
+  static constexpr unsigned TERMINAL = UINT_MAX;
+
+  struct Node {
+    unsigned var;
+    unsigned lo, hi;
+    unsigned ref;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<unsigned> free_nodes;
+  std::vector<std::unordered_map<uint64_t, unsigned>> unique;
+  std::unordered_map<uint64_t, unsigned> computed[3];
+  std::vector<unsigned> level;
+  std::vector<unsigned> var_at;
+  size_t count;
+  const size_t max_nodes;
+  const size_t max_memory;
+
+  static uint64_t key(unsigned a, unsigned b) { return (uint64_t) a << 32 | b; }
+  unsigned levelOf(unsigned f) const;
+  unsigned mk(unsigned var, unsigned lo, unsigned hi);
+  void checkLimits() const;
+  void freeDead(unsigned var);
+  void swapLevels(unsigned i);
+  void sift(unsigned var);
+
+ public:
+  BDD(unsigned nb_vars, size_t max_nodes, size_t max_memory);
+
+  unsigned variable(unsigned var);
+  unsigned apply(Op op, unsigned f, unsigned g);
+  unsigned negate(unsigned f);
+
+  void ref(unsigned f);
+  void deref(unsigned f);
+  void collectGarbage();
+  void reorder();
+
+  /* Number of nodes, dead ones included */
+  size_t size() const { return count; }
+  size_t memory() const;
+
+  /* Probability of f, variable v being true with probability prob[v] */
+  double probability(unsigned f, const std::vector<double> &prob) const;
+};
+
+#endif /* BDD_H */
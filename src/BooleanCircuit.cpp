@@ -1,27 +1,39 @@
 #include "BooleanCircuit.h"
+#include "BDD.h"
+#include "TreeDecomposition.h"
+#include "DPLLCompiler.h"
 
 extern "C" {
 #include "provsql_utils.h"
 #include <unistd.h>
 #include <math.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 }
 
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <unordered_map>
 #include <cassert>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
 #include <iostream>
+#include <atomic>
+#include <bitset>
+#include <thread>
 
 using namespace std;
 
 // Has to be redefined because of name hiding
 unsigned BooleanCircuit::setGate(const uuid &u, BooleanGate type)
 {
- unsigned id = Circuit::setGate(u, type);
-  if(type == BooleanGate::IN)
-    inputs.insert(id);
-  return id;
+  return Circuit::setGate(u, type);
 }
 
 unsigned BooleanCircuit::setGate(const uuid &u, BooleanGate type, double p)
@@ -31,6 +43,18 @@ unsigned BooleanCircuit::setGate(const uuid &u, BooleanGate type, double p)
   return id;
 }
 
+unsigned BooleanCircuit::setGate(BooleanGate type)
+{
+  return Circuit::setGate(type);
+}
+
+unsigned BooleanCircuit::setGate(BooleanGate type, double p)
+{
+  unsigned id = setGate(type);
+  prob[id] = p;
+  return id;
+}
+
 unsigned BooleanCircuit::addGate()
 {
   unsigned id=Circuit::addGate();
@@ -85,297 +109,1740 @@ std::string BooleanCircuit::toString(unsigned g) const
   return "("+result+")";
 }
 
+// Single pass over the gates in topological order, so that gates shared
+// in the d-DNNF, as produced by component caching, are only evaluated
+// once, and deep d-DNNFs do not exhaust the stack
 double BooleanCircuit::dDNNFEvaluation(unsigned g) const
 {
-  switch(gates[g]) {
-    case BooleanGate::IN:
-      return prob[g];
-    case BooleanGate::NOT:
-      return 1-prob[g];
-    case BooleanGate::AND:
-      break;
-    case BooleanGate::OR:
-      break;
-    case BooleanGate::UNDETERMINED:
-      throw CircuitException("Incorrect gate type");
+  vector<double> value(gates.size());
+
+  for(auto h : topologicalOrder({g})) {
+    switch(gates[h]) {
+      case BooleanGate::IN:
+        value[h] = prob[h];
+        break;
+      case BooleanGate::NOT:
+        value[h] = 1-value[wires[h][0]];
+        break;
+      case BooleanGate::AND:
+        value[h] = 1;
+        for(auto s: wires[h])
+          value[h] *= value[s];
+        break;
+      case BooleanGate::OR:
+        value[h] = 0;
+        for(auto s: wires[h])
+          value[h] += value[s];
+        break;
+      case BooleanGate::UNDETERMINED:
+        throw CircuitException("Incorrect gate type");
+    }
   }
 
-  double result=(gates[g]==BooleanGate::AND?1:0);
-  for(auto s: wires[g]) {
-    double d = dDNNFEvaluation(s);
-    if(gates[g]==BooleanGate::AND)
-      result*=d;
-    else
-      result+=d;
+  return value[g];
+}
+
+vector<unsigned> BooleanCircuit::topologicalOrder(const vector<unsigned> &roots) const
+{
+  vector<unsigned> result;
+  // A gate is only expanded the first time it is popped, and is output
+  // once all its children have been, when popped again with the high bit
+  // of the gate number set; a gate may thus be pushed several times
+  enum class State : unsigned char { UNVISITED, EXPANDED, OUTPUT };
+  vector<State> state(gates.size(), State::UNVISITED);
+  const unsigned done = 1u << 31;
+  vector<unsigned> stack(roots.begin(), roots.end());
+
+  while(!stack.empty()) {
+    unsigned g = stack.back();
+    stack.pop_back();
+
+    if(g & done) {
+      result.push_back(g & ~done);
+      state[g & ~done] = State::OUTPUT;
+      continue;
+    }
+
+    if(state[g] != State::UNVISITED)
+      continue;
+    state[g] = State::EXPANDED;
+
+    stack.push_back(g | done);
+    for(auto s: wires[g])
+      if(state[s] == State::UNVISITED)
+        stack.push_back(s);
   }
 
   return result;
 }
 
-bool BooleanCircuit::evaluate(unsigned g, const unordered_set<unsigned> &sampled) const
+// Gates are rewritten in topological order, children first, each gate
+// being mapped to an equivalent gate (its representative): constants
+// are folded, AND and OR gates absorb the children of the same type
+// that they are the only parent of, duplicate children are removed,
+// and unary AND and OR gates as well as double negations are replaced
+// by their child. Constants are represented by an AND gate and an OR
+// gate without children.
+vector<unsigned> BooleanCircuit::simplify(const vector<unsigned> &roots)
 {
-  bool disjunction=false;
+  vector<unsigned> order = topologicalOrder(roots);
 
-  switch(gates[g]) {
-    case BooleanGate::IN:
-      return sampled.find(g)!=sampled.end();
-    case BooleanGate::NOT:
-      return !evaluate(*(wires[g].begin()), sampled);
-    case BooleanGate::AND:
-      disjunction = false;
-      break;
-    case BooleanGate::OR:
-      disjunction = true;
-      break;
-    case BooleanGate::UNDETERMINED:
-      throw CircuitException("Incorrect gate type");
+  const unsigned true_gate = setGate(BooleanGate::AND);
+  const unsigned false_gate = setGate(BooleanGate::OR);
+
+  vector<unsigned> nb_parents(gates.size());
+  for(auto g : roots)
+    ++nb_parents[g];
+  for(auto g : order)
+    for(auto s : wires[g])
+      ++nb_parents[s];
+
+  vector<unsigned> rep(gates.size());
+  rep[true_gate] = true_gate;
+  rep[false_gate] = false_gate;
+
+  for(auto g : order) {
+    rep[g] = g;
+
+    switch(gates[g]) {
+      case BooleanGate::IN:
+        if(prob[g] == 0.)
+          rep[g] = false_gate;
+        else if(prob[g] == 1.)
+          rep[g] = true_gate;
+        break;
+
+      case BooleanGate::NOT:
+        {
+          const unsigned s = rep[wires[g][0]];
+          if(s == true_gate)
+            rep[g] = false_gate;
+          else if(s == false_gate)
+            rep[g] = true_gate;
+          else if(gates[s] == BooleanGate::NOT)
+            rep[g] = wires[s][0];
+          else
+            wires[g][0] = s;
+        }
+        break;
+
+      case BooleanGate::AND:
+      case BooleanGate::OR:
+        {
+          const unsigned neutral = gates[g] == BooleanGate::AND ? true_gate : false_gate;
+          const unsigned absorbing = gates[g] == BooleanGate::AND ? false_gate : true_gate;
+          vector<unsigned> children;
+
+          for(auto s : wires[g]) {
+            const unsigned r = rep[s];
+            if(r == neutral)
+              continue;
+            if(r == absorbing) {
+              rep[g] = absorbing;
+              break;
+            }
+            if(r == s && gates[s] == gates[g] && nb_parents[s] == 1)
+              children.insert(children.end(), wires[s].begin(), wires[s].end());
+            else
+              children.push_back(r);
+          }
+          if(rep[g] != g)
+            break;
+
+          sort(children.begin(), children.end());
+          children.erase(unique(children.begin(), children.end()), children.end());
+
+          if(children.empty())
+            rep[g] = neutral;
+          else if(children.size() == 1)
+            rep[g] = children[0];
+          else
+            wires[g] = move(children);
+        }
+        break;
+
+      case BooleanGate::UNDETERMINED:
+        ;
+    }
   }
 
-  for(auto s: wires[g]) {
-    bool e = evaluate(s, sampled);
-    if(disjunction && e)
-      return true;
-    if(!disjunction && !e)
+  vector<unsigned> result;
+  for(auto g : roots)
+    result.push_back(rep[g]);
+  return result;
+}
+
+// Input supports are approximated by signatures, sets of hashed inputs
+// on 256 bits: disjoint signatures imply disjoint supports. A gate is
+// read-once when its children are read-once and have disjoint supports;
+// its probability is then obtained by combining those of its children.
+// Signatures of large supports overlap even when the supports do not:
+// when the signatures of the children of a gate overlap, the inputs
+// below each child are enumerated to confirm that some input is reached
+// from two of them before giving up.
+void BooleanCircuit::readOnce(const vector<unsigned> &order, vector<bitset<256>> &signature,
+                              vector<bool> &read_once, vector<double> &p) const
+{
+  signature.assign(gates.size(), bitset<256>());
+  read_once.assign(gates.size(), false);
+  p.assign(gates.size(), 0.);
+
+  // Gates visited from the current child are marked with its number
+  // visit; inputs are marked with the number of the child they were
+  // reached from
+  vector<unsigned long> mark(gates.size());
+  unsigned long visit = 0;
+  vector<unsigned> stack;
+
+  auto disjoint_supports = [&](unsigned g) {
+    const unsigned long first = visit+1;
+    for(auto s : wires[g]) {
+      ++visit;
+      stack.push_back(s);
+      while(!stack.empty()) {
+        const unsigned h = stack.back();
+        stack.pop_back();
+        if(mark[h] == visit)
+          continue;
+        if(gates[h] == BooleanGate::IN && mark[h] >= first) {
+          stack.clear();
+          return false;
+        }
+        mark[h] = visit;
+        for(auto t : wires[h])
+          stack.push_back(t);
+      }
+    }
+    return true;
+  };
+
+  for(auto g : order) {
+    switch(gates[g]) {
+      case BooleanGate::IN:
+        signature[g].set((g * 0x9E3779B97F4A7C15ULL) >> 56);
+        read_once[g] = true;
+        p[g] = prob[g];
+        break;
+
+      case BooleanGate::NOT:
+        signature[g] = signature[wires[g][0]];
+        read_once[g] = read_once[wires[g][0]];
+        p[g] = 1 - p[wires[g][0]];
+        break;
+
+      case BooleanGate::AND:
+      case BooleanGate::OR:
+        {
+          bool overlap = false;
+          read_once[g] = true;
+          p[g] = 1.;
+          for(auto s : wires[g]) {
+            if(!read_once[s])
+              read_once[g] = false;
+            if((signature[g] & signature[s]).any())
+              overlap = true;
+            signature[g] |= signature[s];
+            p[g] *= gates[g] == BooleanGate::AND ? p[s] : 1 - p[s];
+          }
+          if(read_once[g] && overlap)
+            read_once[g] = disjoint_supports(g);
+          if(gates[g] == BooleanGate::OR)
+            p[g] = 1 - p[g];
+        }
+        break;
+
+      case BooleanGate::UNDETERMINED:
+        signature[g].set();
+    }
+  }
+}
+
+// A gate is owned by its parent when it is its only parent and all its
+// children are owned, or when it does not depend on any input: the
+// inputs of a gate whose children are all owned can only be reached
+// through it, so that it can be replaced by an input, as can a root that
+// is not used by another gate.
+bool BooleanCircuit::evaluateIndependent(const vector<unsigned> &roots, vector<double> &result)
+{
+  vector<unsigned> order = topologicalOrder(roots);
+
+  // Roots count as their own parent
+  vector<unsigned> nb_parents(gates.size());
+  vector<bool> root(gates.size());
+  for(auto g : roots) {
+    ++nb_parents[g];
+    root[g] = true;
+  }
+  for(auto g : order)
+    for(auto s : wires[g])
+      ++nb_parents[s];
+
+  vector<bitset<256>> signature;
+  vector<bool> read_once;
+  vector<double> p;
+  readOnce(order, signature, read_once, p);
+
+  vector<bool> owned(gates.size());
+  vector<unsigned> replaced;
+
+  for(auto g : order) {
+    const bool separated = all_of(wires[g].begin(), wires[g].end(), [&](unsigned s) { return owned[s]; });
+    owned[g] = signature[g].none() || (nb_parents[g] == 1 && separated);
+
+    if(read_once[g] && gates[g] != BooleanGate::IN && (separated || (root[g] && nb_parents[g] == 1)))
+      replaced.push_back(g);
+  }
+
+  for(auto g : replaced) {
+    gates[g] = BooleanGate::IN;
+    prob[g] = p[g];
+    wires[g].clear();
+  }
+
+  result.clear();
+  for(auto g : roots) {
+    if(!read_once[g]) {
+      result.clear();
       return false;
+    }
+    result.push_back(p[g]);
   }
 
-  if(disjunction)
+  return true;
+}
+
+// The children of g are grouped by union-find over the gates of the
+// circuit below g, two gates being in the same set when one is a child
+// of the other: children in different groups share no input. Groups of
+// several children are gathered under a new gate of the type of g.
+double BooleanCircuit::independentComponents(unsigned g, const function<double(unsigned)> &evaluate)
+{
+  if(gates[g] == BooleanGate::NOT)
+    return 1 - independentComponents(wires[g][0], evaluate);
+  if(gates[g] != BooleanGate::AND && gates[g] != BooleanGate::OR)
+    return evaluate(g);
+
+  vector<unsigned> children(wires[g]);
+  sort(children.begin(), children.end());
+  children.erase(unique(children.begin(), children.end()), children.end());
+  if(children.size() == 1)
+    return independentComponents(children[0], evaluate);
+
+  unordered_map<unsigned, unsigned> parent;
+  auto find = [&](unsigned h) {
+    while(parent[h] != h) {
+      parent[h] = parent[parent[h]];
+      h = parent[h];
+    }
+    return h;
+  };
+  for(auto h : topologicalOrder(children))
+    parent[h] = h;
+  for(const auto &p : parent)
+    for(auto s : wires[p.first])
+      parent[find(p.first)] = find(s);
+
+  map<unsigned, vector<unsigned>> groups;
+  for(auto h : children)
+    groups[find(h)].push_back(h);
+  if(groups.size() == 1)
+    return evaluate(g);
+
+  double result = 1.;
+  for(const auto &p : groups) {
+    double q;
+    if(p.second.size() == 1)
+      q = independentComponents(p.second[0], evaluate);
+    else {
+      const unsigned h = setGate(gates[g]);
+      for(auto s : p.second)
+        addWire(h, s);
+      q = evaluate(h);
+    }
+    result *= gates[g] == BooleanGate::AND ? q : 1 - q;
+  }
+
+  return gates[g] == BooleanGate::AND ? result : 1 - result;
+}
+
+// The width is that of a tree decomposition of the factors used by
+// treeDecompositionEvaluation, gates with more than two children being
+// replaced by chains of binary gates in the same way; its computation is
+// given up as soon as it exceeds max_width.
+BooleanCircuit::Statistics BooleanCircuit::statistics(unsigned g, unsigned max_width) const
+{
+  vector<unsigned> order = topologicalOrder({g});
+  Statistics result{};
+  result.gates = order.size();
+
+  vector<unsigned> depth(gates.size());
+  vector<bool> clause(gates.size());
+  unordered_map<unsigned, unsigned> var;
+  for(auto h : order) {
+    const unsigned id = var.size();
+    var[h] = id;
+  }
+  unsigned nb_vars = var.size();
+  vector<vector<unsigned>> scopes;
+
+  for(auto h : order) {
+    const unsigned x = var[h];
+    const auto &w = wires[h];
+
+    result.wires += w.size();
+    for(auto s : w)
+      depth[h] = max(depth[h], depth[s]+1);
+
+    switch(gates[h]) {
+      case BooleanGate::IN:
+        ++result.inputs;
+        clause[h] = true;
+        scopes.push_back({x});
+        break;
+      case BooleanGate::NOT:
+        scopes.push_back({x, var[w[0]]});
+        break;
+      case BooleanGate::AND:
+      case BooleanGate::OR:
+        clause[h] = gates[h] == BooleanGate::AND &&
+          all_of(w.begin(), w.end(), [&](unsigned s) { return gates[s] == BooleanGate::IN; });
+        if(w.empty())
+          scopes.push_back({x});
+        else if(w.size() == 1)
+          scopes.push_back({x, var[w[0]]});
+        else {
+          unsigned y = var[w[0]];
+          for(size_t i=1; i+1<w.size(); ++i) {
+            const unsigned a = nb_vars++;
+            scopes.push_back({a, y, var[w[i]]});
+            y = a;
+          }
+          scopes.push_back({x, y, var[w.back()]});
+        }
+        break;
+      default:
+        throw CircuitException("Incorrect gate type");
+    }
+  }
+
+  result.depth = depth[g];
+  result.dnf = clause[g] || (gates[g] == BooleanGate::OR &&
+    all_of(wires[g].begin(), wires[g].end(), [&](unsigned s) { return clause[s]; }));
+
+  vector<bitset<256>> signature;
+  vector<bool> read_once;
+  vector<double> p;
+  readOnce(order, signature, read_once, p);
+  const auto nb_read_once = count_if(order.begin(), order.end(), [&](unsigned h) {
+    return gates[h] != BooleanGate::IN && read_once[h];
+  });
+  result.read_once = result.gates == result.inputs ? 1. :
+    (double) nb_read_once / (result.gates - result.inputs);
+
+  try {
+    result.width = TreeDecomposition(nb_vars, scopes, max_width).width();
+  } catch(CircuitException &e) {
+    if(provsql_interrupted)
+      throw;
+    result.width = max_width + 1;
+  }
+
+  return result;
+}
+
+// Bernoulli samples for 64 worlds at once: bit i of the result is set
+// with probability p, by comparing 32-bit halves of random numbers to a
+// 32-bit threshold
+static uint64_t sampleWord(Xoshiro256 &rng, double p)
+{
+  if(p <= 0.)
+    return 0;
+  if(p >= 1.)
+    return ~0ULL;
+
+  const uint64_t threshold = (uint64_t) (p * 4294967296.);
+  uint64_t result = 0;
+
+  for(unsigned i=0; i<64; i+=2) {
+    uint64_t r = rng();
+    result |= (uint64_t) ((r & 0xffffffffULL) < threshold) << i;
+    result |= (uint64_t) ((r >> 32) < threshold) << (i+1);
+  }
+
+  return result;
+}
+
+// Evaluates the gates of order (in topological order) on the 64 worlds
+// of a word, sampled with rng
+void BooleanCircuit::sampleWorlds(const vector<unsigned> &order, vector<uint64_t> &value, Xoshiro256 &rng) const
+{
+  for(auto g : order) {
+    uint64_t v;
+
+    switch(gates[g]) {
+      case BooleanGate::IN:
+        v = sampleWord(rng, prob[g]);
+        break;
+      case BooleanGate::NOT:
+        v = ~value[wires[g][0]];
+        break;
+      case BooleanGate::AND:
+        v = ~0ULL;
+        for(auto s: wires[g])
+          v &= value[s];
+        break;
+      default: // OR, other types are rejected by monteCarlo
+        v = 0;
+        for(auto s: wires[g])
+          v |= value[s];
+        break;
+    }
+
+    value[g] = v;
+  }
+}
+
+// Worlds are sampled 64 at a time, as the bits of a 64-bit word per
+// gate; gates on which the roots depend are then evaluated with bitwise
+// operations in a single pass in topological order. The same worlds are
+// used for all roots.
+//
+// The words are split into contiguous ranges, one per thread; thread t
+// draws its worlds from the generator seeded with seed, advanced by t
+// jumps. The result thus only depends on seed and threads. Worker
+// threads only read provsql_interrupted and never call PostgreSQL.
+vector<double> BooleanCircuit::monteCarlo(const vector<unsigned> &roots, unsigned samples, uint64_t seed, unsigned threads) const
+{
+  vector<unsigned> order = topologicalOrder(roots);
+  for(auto g : order)
+    if(gates[g] == BooleanGate::UNDETERMINED)
+      throw CircuitException("Incorrect gate type");
+
+  const unsigned long long nb_words = (samples + 63ULL) / 64;
+  if(threads > nb_words)
+    threads = max(nb_words, 1ULL);
+
+  vector<vector<unsigned long long>> success(threads, vector<unsigned long long>(roots.size()));
+  vector<vector<uint64_t>> value(threads, vector<uint64_t>(gates.size()));
+  atomic<bool> interrupted(false);
+
+  auto worker = [&](unsigned t) {
+    Xoshiro256 rng(seed);
+    for(unsigned j=0; j<t; ++j)
+      rng.jump();
+
+    for(unsigned long long w=nb_words*t/threads; w<nb_words*(t+1)/threads; ++w) {
+      if(interrupted || provsql_interrupted) {
+        interrupted = true;
+        return;
+      }
+
+      sampleWorlds(order, value[t], rng);
+
+      // Only the first samples-64*w worlds of the last word are counted
+      unsigned long long remaining = samples - 64*w;
+      uint64_t mask = remaining >= 64 ? ~0ULL : (1ULL << remaining) - 1;
+      for(unsigned k=0; k<roots.size(); ++k)
+        success[t][k] += __builtin_popcountll(value[t][roots[k]] & mask);
+    }
+  };
+
+  vector<thread> pool;
+  try {
+    for(unsigned t=1; t<threads; ++t)
+      pool.emplace_back(worker, t);
+  } catch(...) {
+    interrupted = true;
+    for(auto &th : pool)
+      th.join();
+    throw;
+  }
+  worker(0);
+  for(auto &th : pool)
+    th.join();
+
+  if(interrupted)
+    throw CircuitException("Interrupted");
+
+  vector<double> result(roots.size());
+  for(unsigned k=0; k<roots.size(); ++k) {
+    unsigned long long total = 0;
+    for(unsigned t=0; t<threads; ++t)
+      total += success[t][k];
+    result[k] = total*1./samples;
+  }
+
+  return result;
+}
+
+// Stopping-rule estimator of Dagum, Karp, Luby and Ross (An optimal
+// algorithm for Monte Carlo estimation, SIAM J. Comput., 2000): worlds
+// are sampled until the root has been satisfied Υ1 times, and Υ1/N,
+// where N is the number of worlds sampled, is then within a factor
+// 1±epsilon of the probability with probability at least 1-delta. The
+// worlds are shared by all roots, N being counted separately for each
+// root; samples receives these values of N. Roots of very small
+// probability would need an unbounded number of worlds: sampling stops
+// after 4ln(2/delta)/epsilon³ worlds, and the remaining roots, marked in
+// capped, are estimated by their frequency of satisfaction, which is
+// then within an additive error of sqrt(epsilon³/8) with probability at
+// least 1-delta.
+vector<double> BooleanCircuit::monteCarloAdaptive(const vector<unsigned> &roots, double epsilon, double delta, uint64_t seed, vector<unsigned long long> &samples, vector<bool> &capped) const
+{
+  vector<unsigned> order = topologicalOrder(roots);
+  for(auto g : order)
+    if(gates[g] == BooleanGate::UNDETERMINED)
+      throw CircuitException("Incorrect gate type");
+
+  const double upsilon1 =
+    1 + (1 + epsilon) * 4 * (M_E - 2) * log(2 / delta) / (epsilon * epsilon);
+  const unsigned long long threshold = ceil(upsilon1);
+  const unsigned long long max_words =
+    ceil(4 * log(2 / delta) / (epsilon * epsilon * epsilon) / 64);
+
+  vector<uint64_t> value(gates.size());
+  vector<unsigned long long> success(roots.size());
+  Xoshiro256 rng(seed);
+  unsigned remaining = roots.size();
+
+  samples.assign(roots.size(), 0);
+  capped.assign(roots.size(), false);
+
+  unsigned long long w;
+  for(w=0; remaining>0 && w<max_words; ++w) {
+    if(provsql_interrupted)
+      throw CircuitException("Interrupted after "+to_string(64*w)+" samples");
+
+    sampleWorlds(order, value, rng);
+
+    for(unsigned k=0; k<roots.size(); ++k) {
+      if(samples[k])
+        continue;
+
+      uint64_t v = value[roots[k]];
+      unsigned long long needed = threshold - success[k];
+
+      if((unsigned long long) __builtin_popcountll(v) < needed) {
+        success[k] += __builtin_popcountll(v);
+        continue;
+      }
+
+      // The threshold is reached within this word, at its needed-th
+      // satisfying world
+      for(unsigned long long i=1; i<needed; ++i)
+        v &= v - 1;
+      samples[k] = 64*w + __builtin_ctzll(v) + 1;
+      --remaining;
+    }
+  }
+
+  vector<double> result(roots.size());
+  for(unsigned k=0; k<roots.size(); ++k)
+    if(samples[k])
+      result[k] = min(1., upsilon1 / samples[k]);
+    else {
+      samples[k] = 64*w;
+      capped[k] = true;
+      result[k] = success[k] * 1. / samples[k];
+    }
+
+  return result;
+}
+
+double BooleanCircuit::monteCarlo(unsigned g, unsigned samples, uint64_t seed, unsigned threads) const
+{
+  return monteCarlo(vector<unsigned>{g}, samples, seed, threads)[0];
+}
+
+// Clauses of a DNF over the inputs equivalent to the sub-circuit rooted
+// at g, each clause being a sorted list of input gates; ANDs are
+// distributed over ORs as long as the DNF has at most max_clauses
+// clauses. An exception is thrown for circuits with negations.
+vector<vector<unsigned>> BooleanCircuit::DNF(unsigned g, unsigned long max_clauses) const
+{
+  vector<unsigned> order = topologicalOrder({g});
+  unordered_map<unsigned, vector<vector<unsigned>>> dnf;
+
+  for(auto h : order) {
+    vector<vector<unsigned>> &d = dnf[h];
+
+    switch(gates[h]) {
+      case BooleanGate::IN:
+        d.push_back({h});
+        break;
+      case BooleanGate::OR:
+        for(auto s: wires[h]) {
+          const auto &ds = dnf[s];
+          if(d.size() + ds.size() > max_clauses)
+            throw CircuitException("Circuit is not in DNF: more than "+to_string(max_clauses)+" clauses");
+          d.insert(d.end(), ds.begin(), ds.end());
+        }
+        break;
+      case BooleanGate::AND:
+        d.push_back({});
+        for(auto s: wires[h]) {
+          const auto &ds = dnf[s];
+          if(d.size() * ds.size() > max_clauses)
+            throw CircuitException("Circuit is not in DNF: more than "+to_string(max_clauses)+" clauses");
+
+          vector<vector<unsigned>> product;
+          for(const auto &c1 : d)
+            for(const auto &c2 : ds) {
+              vector<unsigned> c;
+              set_union(c1.begin(), c1.end(), c2.begin(), c2.end(), back_inserter(c));
+              product.push_back(move(c));
+            }
+          d = move(product);
+        }
+        break;
+      case BooleanGate::NOT:
+        throw CircuitException("Circuit is not in DNF: it contains a negation");
+      default:
+        throw CircuitException("Incorrect gate type");
+    }
+  }
+
+  return dnf[g];
+}
+
+// Clauses are considered by increasing size, and only kept if none of
+// their subsets has been kept before; kept clauses are stored in a trie,
+// in which subsets of a sorted clause are found by following its
+// elements in order
+static vector<vector<unsigned>> absorb(vector<vector<unsigned>> clauses)
+{
+  sort(clauses.begin(), clauses.end(), [](const vector<unsigned> &a, const vector<unsigned> &b) {
+    return a.size() < b.size() || (a.size() == b.size() && a < b);
+  });
+  clauses.erase(unique(clauses.begin(), clauses.end()), clauses.end());
+
+  struct Node {
+    unordered_map<unsigned, unsigned> children;
+    bool terminal = false;
+  };
+  vector<Node> trie(1);
+
+  // Explicit stack of (node, position in the clause) pairs
+  auto subsumed = [&](const vector<unsigned> &c) {
+    vector<pair<unsigned, size_t>> stack = {{0, 0}};
+    while(!stack.empty()) {
+      const auto top = stack.back();
+      stack.pop_back();
+      if(trie[top.first].terminal)
+        return true;
+      for(size_t j=top.second; j<c.size(); ++j) {
+        auto it = trie[top.first].children.find(c[j]);
+        if(it != trie[top.first].children.end())
+          stack.push_back({it->second, j+1});
+      }
+    }
     return false;
-  else
-    return true;
+  };
+
+  vector<vector<unsigned>> result;
+  for(auto &c : clauses) {
+    if(subsumed(c))
+      continue;
+
+    unsigned n = 0;
+    for(auto x : c) {
+      auto it = trie[n].children.find(x);
+      if(it == trie[n].children.end()) {
+        trie.push_back(Node());
+        it = trie[n].children.insert({x, trie.size()-1}).first;
+      }
+      n = it->second;
+    }
+    trie[n].terminal = true;
+    result.push_back(move(c));
+  }
+
+  return result;
 }
 
-double BooleanCircuit::monteCarlo(unsigned g, unsigned samples) const
+unsigned BooleanCircuit::minimizeDNF(unsigned g, unsigned long max_clauses,
+                                     unsigned long &before, unsigned long &after)
 {
-  unsigned success=0;
+  before = after = 0;
 
-  for(unsigned i=0; i<samples; ++i) {
-    unordered_set<unsigned> sampled;
-    for(unsigned in : inputs) {
-      if(rand() *1. / RAND_MAX < prob[in]) {
-        sampled.insert(in);
+  vector<vector<unsigned>> clauses;
+  try {
+    clauses = DNF(g, max_clauses);
+  } catch(CircuitException &) {
+    return g;
+  }
+
+  before = clauses.size();
+  clauses = absorb(move(clauses));
+  after = clauses.size();
+
+  // The DNF is only used if it is smaller than the circuit, which is not
+  // the case when ANDs had to be distributed over ORs
+  unsigned long old_size = 0, new_size = 0;
+  for(auto h : topologicalOrder({g}))
+    old_size += wires[h].size();
+  for(const auto &c : clauses)
+    new_size += c.size() + 1;
+  if(new_size >= old_size)
+    return g;
+
+  const unsigned result = setGate(BooleanGate::OR);
+  for(const auto &c : clauses) {
+    if(c.size() == 1)
+      addWire(result, c[0]);
+    else {
+      const unsigned a = setGate(BooleanGate::AND);
+      for(auto x : c)
+        addWire(a, x);
+      addWire(result, a);
+    }
+  }
+
+  return result;
+}
+
+// Self-adjusting coverage algorithm of Karp, Luby and Madras (Monte-Carlo
+// approximation algorithms for enumeration problems, J. Algorithms,
+// 1989), on the DNF of the sub-circuit rooted at g: the result is within
+// a factor 1±epsilon of the probability with probability at least
+// 1-delta, whatever this probability is
+double BooleanCircuit::KarpLuby(unsigned g, double epsilon, double delta, uint64_t seed) const
+{
+  vector<vector<unsigned>> clauses = DNF(g, 1000000);
+  const unsigned m = clauses.size();
+
+  // Clause i is picked with probability proportional to its probability,
+  // cumulated in weight[i]
+  vector<double> weight;
+  double U = 0.;
+  for(const auto &c : clauses) {
+    double p = 1.;
+    for(auto x : c)
+      p *= prob[x];
+    U += p;
+    weight.push_back(U);
+  }
+
+  if(U == 0.)
+    return 0.;
+
+  const unsigned long long T =
+    ceil(8 * (1 + epsilon) * m * log(3 / delta) / (epsilon * epsilon));
+
+  // A world is sampled lazily: the value of input x is only drawn when
+  // first needed in trial number stamp[x]
+  vector<unsigned long long> stamp(gates.size());
+  vector<bool> value(gates.size());
+  Xoshiro256 rng(seed);
+  unsigned long long steps = 0, trials = 0;
+
+  while(steps < T) {
+    ++trials;
+
+    const auto &ci = clauses[
+      min<size_t>(upper_bound(weight.begin(), weight.end(), rng.uniform()*U) - weight.begin(), m-1)];
+    for(auto x : ci) {
+      stamp[x] = trials;
+      value[x] = true;
+    }
+
+    while(steps < T) {
+      ++steps;
+
+      bool satisfied = true;
+      for(auto x : clauses[rng() % m]) {
+        if(stamp[x] != trials) {
+          stamp[x] = trials;
+          value[x] = rng.uniform() < prob[x];
+        }
+        if(!value[x]) {
+          satisfied = false;
+          break;
+        }
       }
+
+      if(satisfied)
+        break;
     }
 
-    if(evaluate(g, sampled))
-      ++success;
-    
     if(provsql_interrupted)
-      throw CircuitException("Interrupted after "+to_string(i+1)+" samples");
+      throw CircuitException("Interrupted after "+to_string(trials)+" trials");
   }
 
-  return success*1./samples;
+  return min(1., T * U / ((double) m * trials));
 }
 
-double BooleanCircuit::possibleWorlds(unsigned g) const
+// Worlds over the inputs on which g depends are enumerated in Gray-code
+// order, world number i being i^(i>>1): a single input, the one of the
+// lowest bit set in i, changes between consecutive worlds, and only gates
+// whose value changes as a result are updated. Each AND (resp. OR) gate
+// keeps the number of its children that are false (resp. true). Inputs
+// of probability 0 or 1 are not enumerated. The worlds are split in
+// contiguous ranges, one per thread; worker threads never call
+// PostgreSQL.
+double BooleanCircuit::possibleWorlds(unsigned g, unsigned threads) const
 { 
-  if(inputs.size()>=8*sizeof(unsigned long long))
+  vector<unsigned> order = topologicalOrder({g});
+  const unsigned n = order.size();
+  vector<unsigned> local(gates.size());
+  const unsigned root = n-1; // g comes last in topological order
+  for(unsigned l=0; l<n; ++l) {
+    if(gates[order[l]] == BooleanGate::UNDETERMINED)
+      throw CircuitException("Incorrect gate type");
+    local[order[l]] = l;
+  }
+
+  // Parents of each gate of the cone, with the multiplicity of wires
+  vector<unsigned> first_parent(n+1), parents;
+  for(auto h : order)
+    for(auto s : wires[h])
+      ++first_parent[local[s]+1];
+  for(unsigned l=0; l<n; ++l)
+    first_parent[l+1] += first_parent[l];
+  parents.resize(first_parent[n]);
+  {
+    vector<unsigned> next(first_parent.begin(), first_parent.end()-1);
+    for(auto h : order)
+      for(auto s : wires[h])
+        parents[next[local[s]]++] = local[h];
+  }
+
+  vector<unsigned> enumerated;
+  for(auto h : order)
+    if(gates[h] == BooleanGate::IN && prob[h] > 0. && prob[h] < 1.)
+      enumerated.push_back(h);
+
+  const unsigned nb_inputs = enumerated.size();
+  if(nb_inputs >= 8*sizeof(unsigned long long) - 1)
     throw CircuitException("Too many possible worlds to iterate over");
+  const unsigned long long nb = 1ULL << nb_inputs;
+
+  // The probability of a world is the product of that of its low bits,
+  // tabulated, and that of its high bits, that change every 2^low worlds
+  const unsigned low = min(nb_inputs, 16u);
+  vector<double> low_prob = {1.};
+  for(unsigned j=0; j<low; ++j) {
+    const double p = prob[enumerated[j]];
+    const size_t size = low_prob.size();
+    low_prob.resize(2*size);
+    for(size_t k=0; k<size; ++k) {
+      low_prob[k+size] = low_prob[k]*p;
+      low_prob[k] *= 1-p;
+    }
+  }
 
-  unsigned long long nb=(1<<inputs.size());
-  double totalp=0.;
+  if(threads > nb)
+    threads = nb;
 
-  for(unsigned long long i=0; i < nb; ++i) {
-    unordered_set<unsigned> s;
-    double p = 1;
+  vector<double> total(threads);
+  atomic<bool> interrupted(false);
 
-    unsigned j=0;
-    for(unsigned in : inputs) {
-      if(i & (1 << j)) {
-        s.insert(in);
-        p*=prob[in];
-      } else {
-        p*=1-prob[in];
+  auto worker = [&](unsigned t) {
+    const unsigned long long start = nb*t/threads, end = nb*(t+1)/threads;
+    vector<char> value(n);
+    vector<unsigned> count(n);
+    vector<pair<unsigned,bool>> changed;
+
+    unsigned long long world = start ^ (start >> 1);
+    for(unsigned l=0; l<n; ++l) {
+      const unsigned h = order[l];
+      switch(gates[h]) {
+        case BooleanGate::IN:
+          value[l] = prob[h] >= 1.;
+          break;
+        case BooleanGate::NOT:
+          value[l] = !value[local[wires[h][0]]];
+          break;
+        case BooleanGate::AND:
+          for(auto s : wires[h])
+            count[l] += !value[local[s]];
+          value[l] = count[l] == 0;
+          break;
+        default: // OR
+          for(auto s : wires[h])
+            count[l] += value[local[s]];
+          value[l] = count[l] > 0;
       }
-      ++j;
     }
 
-    if(evaluate(g, s))
-      totalp+=p;
-   
-    if(provsql_interrupted)
-      throw CircuitException("Interrupted");
+    // Sets enumerated input j to v and propagates the changes upwards;
+    // changed holds gates with their new value, whose parents are still
+    // to be updated
+    auto set_input = [&](unsigned j, bool v) {
+      const unsigned l = local[enumerated[j]];
+      if(value[l] == v)
+        return;
+      value[l] = v;
+      changed.push_back({l, v});
+
+      while(!changed.empty()) {
+        const unsigned c = changed.back().first;
+        const bool cv = changed.back().second;
+        changed.pop_back();
+
+        for(unsigned k=first_parent[c]; k<first_parent[c+1]; ++k) {
+          const unsigned p = parents[k];
+          bool pv;
+          switch(gates[order[p]]) {
+            case BooleanGate::NOT:
+              pv = !value[c];
+              break;
+            case BooleanGate::AND:
+              count[p] += cv ? -1 : 1;
+              pv = count[p] == 0;
+              break;
+            default: // OR
+              count[p] += cv ? 1 : -1;
+              pv = count[p] > 0;
+          }
+          if(pv != value[p]) {
+            value[p] = pv;
+            changed.push_back({p, pv});
+          }
+        }
+      }
+    };
+
+    auto high_prob = [&]() {
+      double p = 1.;
+      for(unsigned j=low; j<nb_inputs; ++j)
+        p *= (world >> j) & 1 ? prob[enumerated[j]] : 1-prob[enumerated[j]];
+      return p;
+    };
+
+    for(unsigned j=0; j<nb_inputs; ++j)
+      set_input(j, (world >> j) & 1);
+
+    double high = high_prob(), block = 0.;
+    const unsigned long long low_mask = (1ULL << low) - 1;
+
+    for(unsigned long long i=start; ; ) {
+      if(value[root])
+        block += low_prob[world & low_mask];
+
+      if(++i == end)
+        break;
+
+      const unsigned j = __builtin_ctzll(i);
+      world ^= 1ULL << j;
+      set_input(j, (world >> j) & 1);
+
+      if(j >= low) {
+        total[t] += block * high;
+        block = 0.;
+        high = high_prob();
+
+        if(interrupted || provsql_interrupted) {
+          interrupted = true;
+          return;
+        }
+      }
+    }
+
+    total[t] += block * high;
+  };
+
+  vector<thread> pool;
+  try {
+    for(unsigned t=1; t<threads; ++t)
+      pool.emplace_back(worker, t);
+  } catch(...) {
+    interrupted = true;
+    for(auto &th : pool)
+      th.join();
+    throw;
   }
+  worker(0);
+  for(auto &th : pool)
+    th.join();
+
+  if(interrupted)
+    throw CircuitException("Interrupted");
+
+  double result = 0.;
+  for(auto p : total)
+    result += p;
 
-  return totalp;
+  return result;
 }
 
-std::string BooleanCircuit::Tseytin(unsigned g, bool display_prob=false) const {
-  vector<vector<int>> clauses;
-  
-  // Tseytin transformation
-  for(unsigned i=0; i<gates.size(); ++i) {
-    switch(gates[i]) {
+// Clauses of the Tseytin transformation of the gates on which g
+// depends, together with the unit clause of g; order is the topological
+// order of these gates, and variable v of the encoding is gate
+// order[v-1]. Clauses are passed to emit one at a time, in the same
+// buffer
+void BooleanCircuit::TseytinClauses(unsigned g, const vector<unsigned> &order,
+                                    const function<void(const vector<int> &)> &emit) const
+{
+  unordered_map<unsigned, int> var;
+  for(unsigned i=0; i<order.size(); ++i)
+    var[order[i]] = i+1;
+
+  vector<int> c;
+
+  for(auto h : order) {
+    const int id = var[h];
+
+    switch(gates[h]) {
       case BooleanGate::AND:
-        {
-          int id=i+1;
-          vector<int> c = {id};
-          for(int s: wires[i]) {
-            clauses.push_back({-id, s+1});
-            c.push_back(-s-1);
-          }
-          clauses.push_back(c);
-          break;
+        for(auto s: wires[h]) {
+          c = {-id, var[s]};
+          emit(c);
         }
+        c = {id};
+        for(auto s: wires[h])
+          c.push_back(-var[s]);
+        emit(c);
+        break;
 
       case BooleanGate::OR:
-        {
-          int id=i+1;
-          vector<int> c = {-id};
-          for(int s: wires[i]) {
-            clauses.push_back({id, -s-1});
-            c.push_back(s+1);
-          }
-          clauses.push_back(c);
+        for(auto s: wires[h]) {
+          c = {id, -var[s]};
+          emit(c);
         }
+        c = {-id};
+        for(auto s: wires[h])
+          c.push_back(var[s]);
+        emit(c);
         break;
 
       case BooleanGate::NOT:
-        {
-          int id=i+1;
-          int s=*wires[i].begin();
-          clauses.push_back({-id,-s-1});
-          clauses.push_back({id,s+1});
-          break;
-        }
+        c = {-id, -var[wires[h][0]]};
+        emit(c);
+        c = {id, var[wires[h][0]]};
+        emit(c);
+        break;
 
       case BooleanGate::IN:
       case BooleanGate::UNDETERMINED:
         ;
     }
   }
-  clauses.push_back({(int)g+1});
 
+  c = {var[g]};
+  emit(c);
+}
+
+// The clauses are generated twice, to be counted and then written, so
+// that they are never all held in memory
+void BooleanCircuit::Tseytin(unsigned g, const vector<unsigned> &order, ostream &out, bool display_prob) const
+{
+  unsigned long nb_clauses = 0;
+  TseytinClauses(g, order, [&](const vector<int> &) { ++nb_clauses; });
+
+  out << "p cnf " << order.size() << " " << nb_clauses << "\n";
+  TseytinClauses(g, order, [&](const vector<int> &c) {
+    for(int x : c)
+      out << x << " ";
+    out << "0\n";
+  });
+
+  if(display_prob) {
+    for(unsigned i=0; i<order.size(); ++i)
+      if(gates[order[i]] == BooleanGate::IN) {
+        out << "w " << (i+1) << " " << to_string(prob[order[i]]) << "\n";
+        out << "w -" << (i+1) << " " << to_string(1. - prob[order[i]]) << "\n";
+      }
+  }
+}
+
+// Temporary file, removed when destroyed, whatever the path that leads
+// there. On Linux, it is if possible created with memfd_create, and
+// thus only lives in memory; other programs, which inherit its file
+// descriptor, access it as /proc/self/fd/N.
+class TemporaryFile {
   int fd;
-  char cfilename[] = "/tmp/provsqlXXXXXX";
-  fd = mkstemp(cfilename);
-  close(fd);
+  string path;
+
+ public:
+  explicit TemporaryFile(bool in_memory) : fd(-1)
+  {
+#ifdef SYS_memfd_create
+    if(in_memory && access("/proc/self/fd", F_OK) == 0) {
+      fd = syscall(SYS_memfd_create, "provsql", 0);
+      if(fd >= 0) {
+        path = "/proc/self/fd/"+to_string(fd);
+        return;
+      }
+    }
+#endif
+    char filename[] = "/tmp/provsqlXXXXXX";
+    fd = mkstemp(filename);
+    if(fd < 0)
+      throw CircuitException("Error creating temporary file");
+    path = filename;
+  }
+
+  /* File created by another program */
+  explicit TemporaryFile(const string &p) : fd(-1), path(p) {}
 
-  string filename=cfilename;
-  ofstream ofs(filename.c_str());
+  ~TemporaryFile()
+  {
+    if(fd >= 0)
+      close(fd);
+    if(path.compare(0, 14, "/proc/self/fd/") != 0)
+      unlink(path.c_str());
+  }
+
+  TemporaryFile(const TemporaryFile &) = delete;
+  TemporaryFile &operator=(const TemporaryFile &) = delete;
 
-  ofs << "p cnf " << gates.size() << " " << clauses.size() << "\n";
+  const string &name() const { return path; }
+};
 
-  for(unsigned i=0;i<clauses.size();++i) {
-    for(int x : clauses[i]) {
-      ofs << x << " ";
+// Compact form of d-DNNFs: nodes in topological order, numbered from 0,
+// each given by its kind followed either by a literal, or by its number
+// of children and their numbers
+enum : int { NNF_LEAF, NNF_AND, NNF_OR };
+
+// d-DNNF in the NNF format of c2d, in compact form; the file is mapped
+// in memory and tokenized in place, nodes being appended to the result
+// as they are read
+static vector<int> readNNF(const string &filename, unsigned long nb_vars)
+{
+  struct Mapping {
+    const char *data = nullptr;
+    size_t size = 0;
+    ~Mapping() { if(data) munmap(const_cast<char *>(data), size); }
+  } m;
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw CircuitException("Error opening "+filename);
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data != MAP_FAILED) {
+      m.data = static_cast<const char *>(data);
+      m.size = st.st_size;
     }
-    ofs << "0\n";
   }
-  if(display_prob) {
-    for(unsigned in : inputs) {
-      ofs << "w " << (in+1) << " " << to_string(prob[in]) << "\n";
-      ofs << "w -" << (in+1) << " " << to_string(1. - prob[in]) << "\n";
+  close(fd);
+
+  const char *p = m.data, *end = m.data + m.size;
+
+  if(m.size < 4 || memcmp(p, "nnf ", 4)) // unsatisfiable formula
+    return {NNF_OR, 0};
+  p += 4;
+
+  auto blanks = [&]() {
+    while(p<end && (*p==' ' || *p=='\t' || *p=='\r'))
+      ++p;
+  };
+  auto endOfLine = [&]() {
+    blanks();
+    return p==end || *p=='\n';
+  };
+  auto integer = [&]() {
+    blanks();
+    const bool negative = p<end && *p=='-';
+    if(negative)
+      ++p;
+    if(p==end || *p<'0' || *p>'9')
+      throw CircuitException("Unreadable d-DNNF (integer expected)");
+    long result = 0;
+    while(p<end && *p>='0' && *p<='9')
+      result = 10*result + (*p++ - '0');
+    return negative ? -result : result;
+  };
+  auto nextLine = [&]() {
+    while(p<end && *p!='\n')
+      ++p;
+    if(p<end)
+      ++p;
+  };
+
+  integer();
+  integer();
+  const unsigned long nb_variables = integer();
+  nextLine();
+
+  if(nb_variables!=nb_vars)
+    throw CircuitException("Unreadable d-DNNF (wrong number of variables: " + to_string(nb_variables) +" vs " + to_string(nb_vars) + ")");
+
+  vector<int> result;
+  unsigned long nb_read = 0;
+
+  // Children are only counted once read, the count given in the file
+  // being ignored
+  auto children = [&]() {
+    const size_t count = result.size();
+    result.push_back(0);
+    while(!endOfLine()) {
+      const long i = integer();
+      if(i < 0 || (unsigned long) i >= nb_read)
+        throw CircuitException("Unreadable d-DNNF (wrong node number: " + to_string(i) + ")");
+      result.push_back(i);
+      ++result[count];
+    }
+  };
+
+  while(p<end) {
+    if(endOfLine()) {
+      nextLine();
+      continue;
+    }
+
+    const char c = *p++;
+
+    if(c=='O') {
+      integer();
+      integer();
+      result.push_back(NNF_OR);
+      children();
+    } else if(c=='A') {
+      integer();
+      result.push_back(NNF_AND);
+      children();
+    } else if(c=='L') {
+      const long leaf = integer();
+      if(leaf == 0 || (unsigned long) labs(leaf) > nb_vars)
+        throw CircuitException("Unreadable d-DNNF (wrong literal: " + to_string(leaf) + ")");
+      result.push_back(NNF_LEAF);
+      result.push_back(leaf);
+    } else
+      throw CircuitException(string("Unreadable d-DNNF (unknown node type: ")+c+")");
+
+    ++nb_read;
+    nextLine();
+
+    if(nb_read % 65536 == 0 && provsql_interrupted)
+      throw CircuitException("Interrupted");
+  }
+
+  if(nb_read == 0)
+    throw CircuitException("Unreadable d-DNNF (no node)");
+
+  result.shrink_to_fit();
+  return result;
+}
+
+// Evaluation of a d-DNNF in compact form, literal v standing for gate
+// order[v-1], in a single pass since nodes are in topological order
+double BooleanCircuit::compiledEvaluation(const vector<int> &nnf, const vector<unsigned> &order) const
+{
+  vector<double> value;
+
+  for(size_t i=0; i<nnf.size(); ) {
+    if(nnf[i] == NNF_LEAF) {
+      const int lit = nnf[i+1];
+      const unsigned h = order[abs(lit)-1];
+      if(gates[h] == BooleanGate::IN)
+        value.push_back(lit<0 ? 1-prob[h] : prob[h]);
+      else
+        value.push_back(1.);
+      i += 2;
+    } else {
+      const bool conjunction = nnf[i] == NNF_AND;
+      double v = conjunction ? 1. : 0.;
+      for(int j=0; j<nnf[i+1]; ++j) {
+        if(conjunction)
+          v *= value[nnf[i+2+j]];
+        else
+          v += value[nnf[i+2+j]];
+      }
+      value.push_back(v);
+      i += 2+nnf[i+1];
     }
   }
 
-  ofs.close();
+  return value.back();
+}
 
-  return filename;
+static bool externalCompiler(const string &compiler)
+{
+  return compiler=="d4" || compiler=="c2d" || compiler=="minic2d" || compiler=="dsharp";
 }
 
-double BooleanCircuit::compilation(unsigned g, string compiler) const {
-  string filename=BooleanCircuit::Tseytin(g);
-  string outfilename=filename+".nnf";
+// d-DNNF of the Tseytin encoding of the circuit rooted at g, in compact
+// form
+vector<int> BooleanCircuit::compile(unsigned g, const vector<unsigned> &order, const string &compiler) const
+{
+  if(compiler=="internal") {
+    vector<double> weights(order.size()+1, -1.);
+    for(unsigned i=0; i<order.size(); ++i)
+      if(gates[order[i]] == BooleanGate::IN)
+        weights[i+1] = prob[order[i]];
+
+    vector<vector<int>> clauses;
+    TseytinClauses(g, order, [&](const vector<int> &c) { clauses.push_back(c); });
+    DPLLCompiler c(order.size(), clauses, weights);
+    BooleanCircuit dnnf;
+    const unsigned root = c.compile(dnnf);
+    const auto literals = c.literals();
+
+    vector<int> result;
+    unordered_map<unsigned, int> number;
+    for(auto h : dnnf.topologicalOrder({root})) {
+      if(dnnf.gates[h] == BooleanGate::IN) {
+        result.push_back(NNF_LEAF);
+        result.push_back(literals.at(h));
+      } else {
+        result.push_back(dnnf.gates[h] == BooleanGate::AND ? NNF_AND : NNF_OR);
+        result.push_back(dnnf.wires[h].size());
+        for(auto s : dnnf.wires[h])
+          result.push_back(number[s]);
+      }
+      const int id = number.size();
+      number[h] = id;
+    }
+    return result;
+  }
+
+  if(!externalCompiler(compiler))
+    throw CircuitException("Unknown compiler '"+compiler+"'");
+
+  // c2d and minic2d write the d-DNNF next to the CNF, which therefore
+  // needs to be an actual file
+  const bool named_output = compiler=="d4" || compiler=="dsharp";
+  TemporaryFile cnf(named_output);
+  {
+    ofstream ofs(cnf.name().c_str());
+    Tseytin(g, order, ofs, false);
+    if(!ofs)
+      throw CircuitException("Error writing "+cnf.name());
+  }
 
-//  throw CircuitException("filename: "+filename);
+  unique_ptr<TemporaryFile> out;
+  if(named_output)
+    out.reset(new TemporaryFile(true));
+  else
+    out.reset(new TemporaryFile(cnf.name()+".nnf"));
 
   string cmdline=compiler+" ";
   if(compiler=="d4") {
-    cmdline+=filename+" -out="+outfilename;
+    cmdline+=cnf.name()+" -out="+out->name();
   } else if(compiler=="c2d") {
-    cmdline+="-in "+filename+" -silent";
+    cmdline+="-in "+cnf.name()+" -silent";
   } else if(compiler=="minic2d") {
-    cmdline+="-in "+filename;
-  } else if(compiler=="dsharp") {
-    cmdline+="-q -Fnnf "+outfilename+" "+filename;
+    cmdline+="-in "+cnf.name();
   } else {
-    throw CircuitException("Unknown compiler '"+compiler+"'");
+    cmdline+="-q -Fnnf "+out->name()+" "+cnf.name();
   }
 
   int retvalue=system(cmdline.c_str());
 
-  if(unlink(filename.c_str())) {
-    throw CircuitException("Error removing "+filename);
-  }
-
   if(retvalue)    
     throw CircuitException("Error executing "+compiler);
   
-  ifstream ifs(outfilename.c_str());
+  return readNNF(out->name(), order.size());
+}
 
-  string nnf;
-  getline(ifs, nnf, ' ');
+// Files of the store start with the structure of the circuit, so that
+// hash collisions are detected, followed by the d-DNNF
+static const char STORE_MAGIC[8] = {'P','R','O','V','D','N','N','F'};
 
-  if(nnf!="nnf") // unsatisfiable formula
-    return 0.;
+// Checks that a d-DNNF read from the store can be evaluated safely
+static bool validNNF(const vector<int> &nnf, unsigned long nb_vars)
+{
+  unsigned long nb_nodes = 0;
+  for(size_t i=0; i<nnf.size(); ++nb_nodes) {
+    if(i+1 >= nnf.size())
+      return false;
+    if(nnf[i] == NNF_LEAF) {
+      if(nnf[i+1] == 0 || (unsigned long) abs(nnf[i+1]) > nb_vars)
+        return false;
+      i += 2;
+    } else if(nnf[i] == NNF_AND || nnf[i] == NNF_OR) {
+      if(nnf[i+1] < 0 || nnf.size()-i-2 < (size_t) nnf[i+1])
+        return false;
+      for(int j=0; j<nnf[i+1]; ++j)
+        if(nnf[i+2+j] < 0 || (unsigned long) nnf[i+2+j] >= nb_nodes)
+          return false;
+      i += 2+nnf[i+1];
+    } else
+      return false;
+  }
+  return nb_nodes > 0;
+}
 
-  unsigned nb_nodes, foobar, nb_variables;
-  ifs >> nb_nodes >> foobar >> nb_variables;
+static bool loadCompiled(const string &filename, const vector<unsigned> &s, unsigned long nb_vars, vector<int> &nnf)
+{
+  ifstream ifs(filename.c_str(), ios::binary);
+  char magic[sizeof(STORE_MAGIC)];
+  uint64_t size;
+
+  if(!ifs.read(magic, sizeof(magic)) || memcmp(magic, STORE_MAGIC, sizeof(magic)))
+    return false;
+  if(!ifs.read(reinterpret_cast<char *>(&size), sizeof(size)) || size != s.size())
+    return false;
+  vector<unsigned> t(size);
+  if(!ifs.read(reinterpret_cast<char *>(t.data()), size*sizeof(unsigned)) || t != s)
+    return false;
+  if(!ifs.read(reinterpret_cast<char *>(&size), sizeof(size)) || size == 0)
+    return false;
+  nnf.resize(size);
+  return ifs.read(reinterpret_cast<char *>(nnf.data()), size*sizeof(int)) && validNNF(nnf, nb_vars);
+}
 
-  BooleanCircuit dnnf;
+// Written to a temporary file then renamed, so that concurrent readers
+// never see a partial file; failures are ignored, the store being a
+// mere cache
+static void saveCompiled(const string &filename, const vector<unsigned> &s, const vector<int> &nnf)
+{
+  const string tmp = filename+"."+to_string(getpid());
+  {
+    ofstream ofs(tmp.c_str(), ios::binary);
+    uint64_t size = s.size();
+    ofs.write(STORE_MAGIC, sizeof(STORE_MAGIC));
+    ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    ofs.write(reinterpret_cast<const char *>(s.data()), size*sizeof(unsigned));
+    size = nnf.size();
+    ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    ofs.write(reinterpret_cast<const char *>(nnf.data()), size*sizeof(int));
+    if(!ofs) {
+      ofs.close();
+      unlink(tmp.c_str());
+      return;
+    }
+  }
+  if(rename(tmp.c_str(), filename.c_str()))
+    unlink(tmp.c_str());
+}
 
-  if(nb_variables!=gates.size())
-    throw CircuitException("Unreadable d-DNNF (wrong number of variables: " + to_string(nb_variables) +" vs " + to_string(gates.size()) + ")");
+double BooleanCircuit::compilation(unsigned g, string compiler, const string &store) const {
+  // The compiler name is part of the file names of the store
+  if(compiler!="internal" && !externalCompiler(compiler))
+    throw CircuitException("Unknown compiler '"+compiler+"'");
 
-  std::string line;
-  getline(ifs,line);
-  unsigned i=0;
-  while(getline(ifs,line)) {
-    stringstream ss(line);
-    
-    char c;
-    ss >> c;
+  vector<unsigned> order = topologicalOrder({g});
+
+  if(store.empty())
+    return compiledEvaluation(compile(g, order, compiler), order);
+
+  // Structure of the circuit, regardless of probabilities: the type and
+  // children of each gate, gates being numbered in topological order;
+  // circuits of the same structure have the same Tseytin encoding, and
+  // thus the same d-DNNF
+  vector<unsigned> s;
+  unordered_map<unsigned, unsigned> number;
+  for(auto h : order) {
+    s.push_back(static_cast<unsigned>(gates[h]));
+    s.push_back(wires[h].size());
+    for(auto c : wires[h])
+      s.push_back(number[c]);
+    const unsigned id = number.size();
+    number[h] = id;
+  }
 
-    if(c=='O') {
-      int var, args;
-      ss >> var >> args;
-      unsigned id=dnnf.getGate(to_string(i));
-      dnnf.setGate(to_string(i), BooleanGate::OR);
-      int g;
-      while(ss >> g) {
-        unsigned id2=dnnf.getGate(to_string(g));
-        dnnf.addWire(id,id2);
-      }
-    } else if(c=='A') {
-      int args;
-      ss >> args;
-      unsigned id=dnnf.getGate(to_string(i));
-      dnnf.setGate(to_string(i), BooleanGate::AND);
-      int g;
-      while(ss >> g) {
-        unsigned id2=dnnf.getGate(to_string(g));
-        dnnf.addWire(id,id2);
-      }
-    } else if(c=='L') {
-      int leaf;
-      ss >> leaf;
-      if(gates[abs(leaf)-1]==BooleanGate::IN) {
-        if(leaf<0) {
-          dnnf.setGate(to_string(i), BooleanGate::IN, 1-prob[-leaf-1]);
-        } else {
-          dnnf.setGate(to_string(i), BooleanGate::IN, prob[leaf-1]);
-        }
-      } else
-        dnnf.setGate(to_string(i), BooleanGate::IN, 1.);
-    } else 
-      throw CircuitException(string("Unreadable d-DNNF (unknown node type: ")+c+")");
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for(auto x : s) {
+    hash ^= x;
+    hash *= 0x100000001b3ULL;
+  }
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+  const string filename = store+"/"+compiler+"-"+hex;
+
+  vector<int> nnf;
+  if(!loadCompiled(filename, s, order.size(), nnf)) {
+    nnf = compile(g, order, compiler);
+    saveCompiled(filename, s, nnf);
+  }
+
+  return compiledEvaluation(nnf, order);
+}
+
+// The gates on which g depends are compiled bottom-up into an ordered
+// BDD, inputs being numbered in the order in which they are first
+// reached; the BDD of a gate is released once all its parents are
+// compiled, and variables are reordered by sifting whenever the
+// diagram has doubled in size since the last reordering
+double BooleanCircuit::BDDEvaluation(unsigned g, size_t max_nodes, size_t max_memory) const
+{
+  vector<unsigned> order = topologicalOrder({g});
+  unordered_map<unsigned, unsigned> var;
+  vector<double> var_prob;
+  vector<unsigned> uses(gates.size());
+
+  for(auto h : order) {
+    if(gates[h] == BooleanGate::IN) {
+      var[h] = var_prob.size();
+      var_prob.push_back(prob[h]);
+    }
+    for(auto s : wires[h])
+      ++uses[s];
+  }
+
+  BDD bdd(var_prob.size(), max_nodes, max_memory);
+  vector<unsigned> f(gates.size());
+  size_t next_reorder = 4096;
+
+  for(auto h : order) {
+    unsigned r;
+
+    switch(gates[h]) {
+      case BooleanGate::IN:
+        r = bdd.variable(var[h]);
+        break;
+      case BooleanGate::NOT:
+        r = bdd.negate(f[wires[h][0]]);
+        break;
+      case BooleanGate::AND:
+        r = BDD::ONE;
+        for(auto s : wires[h])
+          r = bdd.apply(BDD::Op::AND, r, f[s]);
+        break;
+      case BooleanGate::OR:
+        r = BDD::ZERO;
+        for(auto s : wires[h])
+          r = bdd.apply(BDD::Op::OR, r, f[s]);
+        break;
+      default:
+        throw CircuitException("Incorrect gate type");
+    }
+
+    bdd.ref(r);
+    f[h] = r;
+    for(auto s : wires[h])
+      if(--uses[s] == 0)
+        bdd.deref(f[s]);
+
+    if(bdd.size() > next_reorder) {
+      bdd.collectGarbage();
+      if(bdd.size() > next_reorder/2)
+        bdd.reorder();
+      next_reorder = max(next_reorder, 2*bdd.size());
+    }
 
-    ++i;
+    if(provsql_interrupted)
+      throw CircuitException("Interrupted");
+  }
+
+  return bdd.probability(f[g], var_prob);
+}
+
+// Variable elimination on the factors of the gates on which g depends,
+// along the elimination ordering of a tree decomposition of their
+// graph: the factor of each bag is the product of the factors first
+// eliminated with its vertex and of the messages of its children; its
+// vertex is summed out and the result sent to the parent bag. Gates
+// with more than two children are first replaced by chains of binary
+// gates, so that factors have at most three variables. The cost is
+// linear in the size of the circuit and exponential in the width.
+double BooleanCircuit::treeDecompositionEvaluation(unsigned g, unsigned max_width) const
+{
+  struct Factor {
+    vector<unsigned> vars;
+    vector<double> table; // bit i of the index is the value of vars[i]
+  };
+
+  vector<unsigned> order = topologicalOrder({g});
+  unordered_map<unsigned, unsigned> var;
+  for(auto h : order) {
+    const unsigned id = var.size();
+    var[h] = id;
   }
+  unsigned nb_vars = var.size();
+  vector<Factor> factors;
+
+  // Factor of x = y op z (binary gates), or of x = y (NOT with negate)
+  auto gate_factor = [&](unsigned x, unsigned y, unsigned z, BooleanGate op, bool negate) {
+    Factor f;
+    f.vars = {x, y};
+    if(z != y)
+      f.vars.push_back(z);
+    f.table.resize(1ULL << f.vars.size());
+    for(unsigned i=0; i<f.table.size(); ++i) {
+      const bool vx = i & 1, vy = i & 2, vz = z != y ? (i & 4) != 0 : vy;
+      const bool v = op == BooleanGate::AND ? (vy && vz) : (vy || vz);
+      f.table[i] = vx == (negate ? !v : v);
+    }
+    factors.push_back(move(f));
+  };
+
+  for(auto h : order) {
+    const unsigned x = var[h];
+    const auto &w = wires[h];
 
-  ifs.close();
-  if(unlink(outfilename.c_str())) {
-    throw CircuitException("Error removing "+outfilename);
+    switch(gates[h]) {
+      case BooleanGate::IN:
+        factors.push_back({{x}, {1-prob[h], prob[h]}});
+        break;
+      case BooleanGate::NOT:
+        gate_factor(x, var[w[0]], var[w[0]], BooleanGate::AND, true);
+        break;
+      case BooleanGate::AND:
+      case BooleanGate::OR:
+        if(w.empty())
+          factors.push_back({{x}, gates[h] == BooleanGate::AND ? vector<double>{0., 1.} : vector<double>{1., 0.}});
+        else {
+          unsigned y = var[w[0]];
+          for(size_t i=1; i+1<w.size(); ++i) {
+            const unsigned a = nb_vars++;
+            gate_factor(a, y, var[w[i]], gates[h], false);
+            y = a;
+          }
+          gate_factor(x, y, var[w.back()], gates[h], false);
+        }
+        break;
+      default:
+        throw CircuitException("Incorrect gate type");
+    }
+  }
+  factors.push_back({{var[g]}, {0., 1.}});
+
+  vector<vector<unsigned>> scopes;
+  for(const auto &f : factors)
+    scopes.push_back(f.vars);
+  TreeDecomposition td(nb_vars, scopes, max_width);
+
+  vector<vector<Factor>> bucket(nb_vars);
+  for(auto &f : factors) {
+    const unsigned v = *min_element(f.vars.begin(), f.vars.end(),
+                                    [&](unsigned a, unsigned b) { return td.rank(a) < td.rank(b); });
+    bucket[v].push_back(move(f));
   }
 
-//  throw CircuitException(toString(g) + "\n" + dnnf.toString(dnnf.getGate(to_string(i-1))));
+  double result = 1.;
+
+  for(auto v : td.eliminationOrder()) {
+    const auto &bag = td.bag(v);
+    vector<double> table(1ULL << bag.size(), 1.);
 
-  return dnnf.dDNNFEvaluation(dnnf.getGate(to_string(i-1)));
+    for(const auto &f : bucket[v]) {
+      vector<unsigned> bit;
+      for(auto u : f.vars)
+        bit.push_back(find(bag.begin(), bag.end(), u) - bag.begin());
+
+      for(size_t i=0; i<table.size(); ++i) {
+        size_t k = 0;
+        for(size_t j=0; j<bit.size(); ++j)
+          k |= ((i >> bit[j]) & 1) << j;
+        table[i] *= f.table[k];
+      }
+    }
+    bucket[v].clear();
+
+    // v is bit 0 of the bag
+    Factor message;
+    message.vars.assign(bag.begin()+1, bag.end());
+    message.table.resize(table.size()/2);
+    for(size_t i=0; i<message.table.size(); ++i)
+      message.table[i] = table[2*i] + table[2*i+1];
+
+    const unsigned p = td.parent(v);
+    if(p == v)
+      result *= message.table[0];
+    else
+      bucket[p].push_back(move(message));
+
+    if(provsql_interrupted)
+      throw CircuitException("Interrupted");
+  }
+
+  return result;
 }
 
 double BooleanCircuit::WeightMC(unsigned g, string opt) const {
-  string filename=BooleanCircuit::Tseytin(g, true);
+  TemporaryFile cnf(true);
+  {
+    ofstream ofs(cnf.name().c_str());
+    Tseytin(g, topologicalOrder({g}), ofs, true);
+    if(!ofs)
+      throw CircuitException("Error writing "+cnf.name());
+  }
 
   //opt of the form 'delta;epsilon'
   stringstream ssopt(opt); 
@@ -403,7 +1870,8 @@ double BooleanCircuit::WeightMC(unsigned g, string opt) const {
   //calcul pivotAC
   const double pivotAC=2*ceil(exp(3./2)*(1+1/epsilon)*(1+1/epsilon));
 
-  string cmdline="weightmc --startIteration=0 --gaussuntil=400 --verbosity=0 --pivotAC="+to_string(pivotAC)+ " "+filename+" > "+filename+".out";
+  TemporaryFile out(true);
+  string cmdline="weightmc --startIteration=0 --gaussuntil=400 --verbosity=0 --pivotAC="+to_string(pivotAC)+ " "+cnf.name()+" > "+out.name();
 
   int retvalue=system(cmdline.c_str());
   if(retvalue) {
@@ -411,7 +1879,7 @@ double BooleanCircuit::WeightMC(unsigned g, string opt) const {
   }
 
   //parsing
-  ifstream ifs((filename+".out").c_str());
+  ifstream ifs(out.name().c_str());
   string line, prev_line;
   while(getline(ifs,line))
     prev_line=line;
@@ -431,13 +1899,5 @@ double BooleanCircuit::WeightMC(unsigned g, string opt) const {
 //  throw CircuitException(to_string(ret));
 
 
-//  if(unlink(filename.c_str())) {
-//    throw CircuitException("Error removing "+filename);
-//  }
-
-  if(unlink((filename+".out").c_str())) {
-    throw CircuitException("Error removing "+filename+".out");
-  }
-
   return ret;
 }
@@ -1,30 +1,82 @@
 #ifndef BOOLEAN_CIRCUIT_H
 #define BOOLEAN_CIRCUIT_H
 
+#include <bitset>
+#include <functional>
+#include <ostream>
 #include <unordered_map>
 #include <unordered_set>
-#include <set>
 #include <vector>
 
 #include "Circuit.hpp"
+#include "Xoshiro256.h"
 
 enum class BooleanGate { UNDETERMINED, AND, OR, NOT, IN };
 
 class BooleanCircuit : public Circuit<BooleanGate> {
  private:
-  std::set<unsigned> inputs;
   std::vector<double> prob;
-  bool evaluate(unsigned g, const std::unordered_set<unsigned> &sampled) const;
-  std::string Tseytin(unsigned g, bool display_prob) const;
+  std::vector<unsigned> topologicalOrder(const std::vector<unsigned> &roots) const;
+  void readOnce(const std::vector<unsigned> &order, std::vector<std::bitset<256>> &signature,
+                std::vector<bool> &read_once, std::vector<double> &p) const;
+  void TseytinClauses(unsigned g, const std::vector<unsigned> &order,
+                      const std::function<void(const std::vector<int> &)> &emit) const;
+  void Tseytin(unsigned g, const std::vector<unsigned> &order, std::ostream &out, bool display_prob) const;
+  std::vector<int> compile(unsigned g, const std::vector<unsigned> &order, const std::string &compiler) const;
+  double compiledEvaluation(const std::vector<int> &nnf, const std::vector<unsigned> &order) const;
+  std::vector<std::vector<unsigned>> DNF(unsigned g, unsigned long max_clauses) const;
+  void sampleWorlds(const std::vector<unsigned> &order, std::vector<uint64_t> &value, Xoshiro256 &rng) const;
 
  public:
   unsigned addGate() override;
   unsigned setGate(const uuid &u, BooleanGate t) override;
   unsigned setGate(const uuid &u, BooleanGate t, double p);
+  unsigned setGate(BooleanGate t) override;
+  unsigned setGate(BooleanGate t, double p);
 
-  double possibleWorlds(unsigned g) const;
-  double compilation(unsigned g, std::string compiler) const;
-  double monteCarlo(unsigned g, unsigned samples) const;
+  /* Rewrites the circuits rooted at roots into smaller equivalent
+   * ones, and returns their new roots */
+  std::vector<unsigned> simplify(const std::vector<unsigned> &roots);
+
+  /* Root of a minimal DNF equivalent to the circuit rooted at g, without
+   * duplicate or subsumed clauses, or g if this circuit has negations,
+   * a DNF of more than max_clauses clauses, or a smaller size than this
+   * DNF; the numbers of clauses before and after minimization are
+   * stored in before and after */
+  unsigned minimizeDNF(unsigned g, unsigned long max_clauses, unsigned long &before, unsigned long &after);
+
+  /* Replaces the read-once sub-circuits of the circuits rooted at roots,
+   * on which the rest of these circuits do not depend, by inputs of the
+   * same probability; if all roots are read-once, their probabilities
+   * are stored in result and true is returned */
+  bool evaluateIndependent(const std::vector<unsigned> &roots, std::vector<double> &result);
+
+  /* Probability of g, obtained by combining the probabilities of the
+   * sub-circuits of g that share no input, each computed by evaluate */
+  double independentComponents(unsigned g, const std::function<double(unsigned)> &evaluate);
+
+  struct Statistics {
+    unsigned long gates, wires, inputs;
+    unsigned depth;
+    bool dnf;         // disjunction of conjunctions of inputs
+    double read_once; // fraction of the gates other than inputs that are read-once
+    unsigned width;   // estimated treewidth, or max_width+1 if larger
+  };
+  /* Statistics of the sub-circuit rooted at g, cheap to compute, from
+   * which the cost of evaluation methods can be estimated */
+  Statistics statistics(unsigned g, unsigned max_width) const;
+
+  double possibleWorlds(unsigned g, unsigned threads = 1) const;
+  /* Compilation into a d-DNNF; if store is not empty, d-DNNFs are kept
+   * there, in files keyed by the structure of the circuit, and reused
+   * for circuits of the same structure whatever their probabilities */
+  double compilation(unsigned g, std::string compiler, const std::string &store = std::string()) const;
+  double monteCarlo(unsigned g, unsigned samples, uint64_t seed, unsigned threads = 1) const;
+  std::vector<double> monteCarlo(const std::vector<unsigned> &roots, unsigned samples, uint64_t seed, unsigned threads = 1) const;
+  std::vector<double> monteCarloAdaptive(const std::vector<unsigned> &roots, double epsilon, double delta, uint64_t seed, std::vector<unsigned long long> &samples, std::vector<bool> &capped) const;
+  double BDDEvaluation(unsigned g, size_t max_nodes, size_t max_memory) const;
+  double treeDecompositionEvaluation(unsigned g, unsigned max_width) const;
+  double KarpLuby(unsigned g, double epsilon, double delta, uint64_t seed) const;
   double WeightMC(unsigned g, std::string opt) const;
 
   double dDNNFEvaluation(unsigned g) const;
@@ -5,28 +5,44 @@
 #include "c.h" // for int16
 
 extern "C" {
-#include "utils/uuid.h"
-
-#if PG_VERSION_NUM < 100000
-/* In versions of PostgreSQL < 10, pg_uuid_t is declared to be an opaque
- * struct pg_uuid_t in uuid.h, so we have to give the definition of
- * struct pg_uuid_t; this problem is resolved in PostgreSQL 10 */
-#define UUID_LEN 16
-  struct pg_uuid_t
-  {
-    unsigned char data[UUID_LEN];
-  };
-#endif /* PG_VERSION_NUM */
-}  
+#include "provsql_utils.h"
+}
 
+#include <cstring>
+#include <functional>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+/* Tokens are kept in their 16-byte binary form; as they are produced
+ * by SHA-1 (version 5) or randomly (version 4), their first bytes are
+ * already uniformly distributed and can directly serve as a hash */
+inline bool operator==(const pg_uuid_t &u, const pg_uuid_t &v)
+{
+  return memcmp(u.data, v.data, UUID_LEN)==0;
+}
+
+inline bool operator<(const pg_uuid_t &u, const pg_uuid_t &v)
+{
+  return memcmp(u.data, v.data, UUID_LEN)<0;
+}
+
+namespace std {
+  template<> struct hash<pg_uuid_t> {
+    size_t operator()(const pg_uuid_t &u) const
+    {
+      size_t h;
+      memcpy(&h, u.data, sizeof(h));
+      return h;
+    }
+  };
+}
+
 template<class gateType>
 class Circuit {
  public:
-  using uuid = std::string;
+  using uuid = pg_uuid_t;
 
  private:
   std::unordered_map<uuid, unsigned> uuid2id;
@@ -38,6 +54,7 @@ class Circuit {
  public:
   virtual unsigned addGate();
   virtual unsigned setGate(const uuid &u, gateType t);
+  virtual unsigned setGate(gateType t);
   bool hasGate(const uuid &u) const;
   unsigned getGate(const uuid &u);
   void addWire(unsigned f, unsigned t);
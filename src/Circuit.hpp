@@ -35,6 +35,14 @@ unsigned Circuit<gateType>::setGate(const uuid &u, gateType type)
   return id;
 }
 
+template<class gateType>
+unsigned Circuit<gateType>::setGate(gateType type)
+{
+  unsigned id = addGate();
+  gates[id] = type;
+  return id;
+}
+
 template<class gateType>
 void Circuit<gateType>::addWire(unsigned f, unsigned t)
 {
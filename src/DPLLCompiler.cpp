@@ -0,0 +1,412 @@
+#include "DPLLCompiler.h"
+
+extern "C" {
+#include "provsql_utils.h"
+}
+
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+constexpr unsigned DPLLCompiler::NO_REASON;
+constexpr unsigned DPLLCompiler::MAX_LEARNED;
+constexpr size_t DPLLCompiler::MAX_CACHE;
+
+DPLLCompiler::DPLLCompiler(unsigned n, const vector<vector<int>> &cnf, const vector<double> &w) :
+  nb_vars(n), weights(w), watches(2*(n+1)),
+  value(n+1, -1), level(n+1), reason(n+1, NO_REASON), propagated(0),
+  current_level(0), parent(n+1), stamp(n+1), current_stamp(0),
+  score(n+1), dnnf(nullptr),
+  false_gate(0), leaves(2*(n+1), NO_REASON)
+{
+  // Literals are deduplicated and tautologies removed; unit clauses are
+  // kept, without watches, and assigned at level 0 by compile
+  for(const auto &c : cnf) {
+    vector<int> d(c);
+    sort(d.begin(), d.end());
+    d.erase(unique(d.begin(), d.end()), d.end());
+
+    bool tautology = false;
+    for(auto l : d)
+      if(l>0 && binary_search(d.begin(), d.end(), -l))
+        tautology = true;
+    if(tautology)
+      continue;
+
+    addWatchedClause(move(d));
+  }
+
+  nb_original = clauses.size();
+}
+
+void DPLLCompiler::addWatchedClause(vector<int> &&c)
+{
+  if(c.size()>=2) {
+    watches[index(c[0])].push_back(clauses.size());
+    watches[index(c[1])].push_back(clauses.size());
+  }
+  clauses.push_back(move(c));
+}
+
+void DPLLCompiler::assign(int lit, unsigned r)
+{
+  value[abs(lit)] = lit>0;
+  level[abs(lit)] = current_level;
+  reason[abs(lit)] = r;
+  trail.push_back(lit);
+}
+
+// Unit propagation with two watched literals, the first two of each
+// clause; returns the conflicting clause, or NO_REASON
+unsigned DPLLCompiler::propagate()
+{
+  while(propagated < trail.size()) {
+    const int false_lit = -trail[propagated++];
+    vector<unsigned> &ws = watches[index(false_lit)];
+    size_t i=0, j=0;
+
+    while(i<ws.size()) {
+      const unsigned cid = ws[i++];
+      vector<int> &c = clauses[cid];
+
+      if(c[0] == false_lit)
+        swap(c[0], c[1]);
+
+      if(isTrue(c[0])) {
+        ws[j++] = cid;
+        continue;
+      }
+
+      bool moved = false;
+      for(size_t k=2; k<c.size(); ++k)
+        if(!isFalse(c[k])) {
+          swap(c[1], c[k]);
+          watches[index(c[1])].push_back(cid);
+          moved = true;
+          break;
+        }
+      if(moved)
+        continue;
+
+      ws[j++] = cid;
+      if(isFalse(c[0])) {
+        while(i<ws.size())
+          ws[j++] = ws[i++];
+        ws.resize(j);
+        return cid;
+      }
+      assign(c[0], cid);
+    }
+
+    ws.resize(j);
+  }
+
+  return NO_REASON;
+}
+
+// First-UIP conflict analysis; the learned clause is only used for
+// propagation, components being computed on the original clauses.
+// Backtracking remains chronological.
+void DPLLCompiler::learn(unsigned conflict)
+{
+  if(clauses.size() - nb_original >= MAX_LEARNED || current_level == 0)
+    return;
+
+  vector<bool> seen(nb_vars+1);
+  vector<int> learned = {0};
+  unsigned pending = 0;
+  size_t t = trail.size();
+  int uip = 0;
+  unsigned cid = conflict;
+
+  do {
+    for(auto l : clauses[cid]) {
+      const unsigned v = abs(l);
+      if(l == uip || seen[v] || level[v] == 0)
+        continue;
+      seen[v] = true;
+      if(level[v] == current_level)
+        ++pending;
+      else
+        learned.push_back(l);
+    }
+
+    do {
+      --t;
+    } while(!seen[abs(trail[t])]);
+    uip = trail[t];
+    cid = reason[abs(uip)];
+    --pending;
+  } while(pending > 0);
+
+  learned[0] = -uip;
+  if(learned.size() < 2)
+    return;
+
+  // The second watch is the literal assigned last, so that the watches
+  // are unassigned first on backtracking
+  auto last = max_element(learned.begin()+1, learned.end(),
+                          [&](int a, int b) { return level[abs(a)] < level[abs(b)]; });
+  swap(learned[1], *last);
+  addWatchedClause(move(learned));
+}
+
+void DPLLCompiler::backtrack(size_t trail_size)
+{
+  while(trail.size() > trail_size) {
+    const unsigned v = abs(trail.back());
+    value[v] = -1;
+    reason[v] = NO_REASON;
+    trail.pop_back();
+  }
+  propagated = trail_size;
+}
+
+// Input gate of the d-DNNF for a weighted literal
+unsigned DPLLCompiler::leaf(int lit)
+{
+  unsigned &l = leaves[index(lit)];
+  if(l == NO_REASON) {
+    const double p = weights[abs(lit)];
+    l = dnnf->setGate(BooleanGate::IN, lit>0 ? p : 1-p);
+  }
+  return l;
+}
+
+// Connected components of the clauses of clause_ids that are not
+// satisfied, two clauses being connected when they share an unassigned
+// variable; each component is returned as its sorted clauses and
+// variables
+vector<pair<vector<unsigned>,vector<unsigned>>> DPLLCompiler::components(const vector<unsigned> &clause_ids)
+{
+  // Union-find over the unassigned variables, those of the current call
+  // being stamped
+  ++current_stamp;
+  vector<unsigned> vars;
+  auto find = [&](unsigned v) {
+    while(parent[v] != v) {
+      parent[v] = parent[parent[v]];
+      v = parent[v];
+    }
+    return v;
+  };
+
+  vector<unsigned> active;
+  for(auto cid : clause_ids) {
+    const auto &c = clauses[cid];
+    if(any_of(c.begin(), c.end(), [&](int l) { return isTrue(l); }))
+      continue;
+    active.push_back(cid);
+
+    unsigned first = 0;
+    for(auto l : c) {
+      const unsigned v = abs(l);
+      if(value[v] != -1)
+        continue;
+      if(stamp[v] != current_stamp) {
+        stamp[v] = current_stamp;
+        parent[v] = v;
+        vars.push_back(v);
+      }
+      if(first == 0)
+        first = v;
+      else
+        parent[find(v)] = find(first);
+    }
+  }
+
+  // Components are numbered in the order of their representatives
+  vector<pair<vector<unsigned>,vector<unsigned>>> result;
+  for(auto v : vars)
+    parent[v] = find(v);
+  vector<unsigned> component_of;
+  for(auto v : vars)
+    if(parent[v] == v) {
+      component_of.push_back(v);
+      result.push_back({});
+    }
+  sort(component_of.begin(), component_of.end());
+
+  auto component = [&](unsigned v) {
+    return lower_bound(component_of.begin(), component_of.end(), parent[v]) - component_of.begin();
+  };
+
+  for(auto cid : active)
+    for(auto l : clauses[cid])
+      if(value[abs(l)] == -1) {
+        result[component(abs(l))].first.push_back(cid);
+        break;
+      }
+
+  for(auto v : vars)
+    result[component(v)].second.push_back(v);
+
+  for(auto &c : result) {
+    sort(c.first.begin(), c.first.end());
+    sort(c.second.begin(), c.second.end());
+  }
+
+  return result;
+}
+
+// d-DNNF of the component when lit is decided: the conjunction of the
+// weighted literals of the component that it implies and of the d-DNNF
+// of the remaining components
+unsigned DPLLCompiler::compileBranch(int lit, const vector<unsigned> &clause_ids, const vector<unsigned> &vars)
+{
+  const size_t mark = trail.size();
+  const size_t cache_mark = cache_log.size();
+  ++current_level;
+  assign(lit, NO_REASON);
+
+  unsigned result = false_gate;
+  const unsigned conflict = propagate();
+
+  if(conflict != NO_REASON) {
+    learn(conflict);
+  } else {
+    vector<unsigned> children;
+    for(size_t i=mark; i<trail.size(); ++i) {
+      const int l = trail[i];
+      if(weights[abs(l)] >= 0. && binary_search(vars.begin(), vars.end(), (unsigned) abs(l)))
+        children.push_back(leaf(l));
+    }
+
+    bool satisfiable = true;
+    for(const auto &c : components(clause_ids)) {
+      const unsigned g = compileComponent(c.first, c.second);
+      if(g == false_gate) {
+        satisfiable = false;
+        break;
+      }
+      children.push_back(g);
+    }
+
+    if(satisfiable) {
+      result = dnnf->setGate(BooleanGate::AND);
+      for(auto g : children)
+        dnnf->addWire(result, g);
+    }
+  }
+
+  backtrack(mark);
+  --current_level;
+
+  // An unsatisfiable branch may have been found so through clauses
+  // learned in a context where a sibling component is unsatisfiable:
+  // results cached within this branch are then not to be trusted
+  if(result == false_gate) {
+    for(size_t i=cache_mark; i<cache_log.size(); ++i)
+      cache.erase(cache_log[i]);
+    if(cache_log.size() > cache_mark)
+      cache_log.resize(cache_mark);
+  }
+
+  return result;
+}
+
+unsigned DPLLCompiler::compileComponent(const vector<unsigned> &clause_ids, const vector<unsigned> &vars)
+{
+  string key(reinterpret_cast<const char *>(vars.data()), vars.size()*sizeof(unsigned));
+  key += '|';
+  key.append(reinterpret_cast<const char *>(clause_ids.data()), clause_ids.size()*sizeof(unsigned));
+
+  auto it = cache.find(key);
+  if(it != cache.end())
+    return it->second;
+
+  if(provsql_interrupted)
+    throw CircuitException("Interrupted");
+
+  // Decision on the input variable with the most occurrences in the
+  // clauses of the component, or on any variable if there is none
+  for(auto cid : clause_ids)
+    for(auto l : clauses[cid])
+      ++score[abs(l)];
+
+  unsigned decision = 0, best = 0;
+  bool input = false;
+  for(auto v : vars) {
+    const bool is_input = weights[v] >= 0.;
+    if(decision == 0 || (is_input && !input) || (is_input == input && score[v] > best)) {
+      decision = v;
+      best = score[v];
+      input = is_input;
+    }
+  }
+
+  for(auto cid : clause_ids)
+    for(auto l : clauses[cid])
+      score[abs(l)] = 0;
+
+  const unsigned positive = compileBranch(decision, clause_ids, vars);
+  const unsigned negative = compileBranch(-(int) decision, clause_ids, vars);
+
+  unsigned result;
+  if(positive == false_gate)
+    result = negative;
+  else if(negative == false_gate)
+    result = positive;
+  else {
+    result = dnnf->setGate(BooleanGate::OR);
+    dnnf->addWire(result, positive);
+    dnnf->addWire(result, negative);
+  }
+
+  if(cache.size() >= MAX_CACHE) {
+    cache.clear();
+    cache_log.clear();
+  }
+  cache[key] = result;
+  cache_log.push_back(move(key));
+
+  return result;
+}
+
+unsigned DPLLCompiler::compile(BooleanCircuit &d)
+{
+  dnnf = &d;
+  false_gate = dnnf->setGate(BooleanGate::OR);
+
+  for(unsigned cid=0; cid<nb_original; ++cid) {
+    const auto &c = clauses[cid];
+    if(c.empty() || (c.size() == 1 && isFalse(c[0])))
+      return false_gate;
+    if(c.size() == 1 && !isTrue(c[0]))
+      assign(c[0], NO_REASON);
+  }
+  if(propagate() != NO_REASON)
+    return false_gate;
+
+  vector<unsigned> children;
+  for(auto l : trail)
+    if(weights[abs(l)] >= 0.)
+      children.push_back(leaf(l));
+
+  vector<unsigned> all(nb_original);
+  for(unsigned cid=0; cid<nb_original; ++cid)
+    all[cid] = cid;
+
+  for(const auto &c : components(all)) {
+    const unsigned g = compileComponent(c.first, c.second);
+    if(g == false_gate)
+      return false_gate;
+    children.push_back(g);
+  }
+
+  const unsigned root = dnnf->setGate(BooleanGate::AND);
+  for(auto g : children)
+    dnnf->addWire(root, g);
+
+  return root;
+}
+
+unordered_map<unsigned, int> DPLLCompiler::literals() const
+{
+  unordered_map<unsigned, int> result;
+  for(unsigned i=2; i<leaves.size(); ++i)
+    if(leaves[i] != NO_REASON)
+      result[leaves[i]] = i%2 ? -(int) (i/2) : (int) (i/2);
+  return result;
+}
@@ -0,0 +1,75 @@
+#ifndef DPLL_COMPILER_H
+#define DPLL_COMPILER_H
+
+#include <climits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BooleanCircuit.h"
+
+/* Compiler of a CNF into a d-DNNF, by an exhaustive DPLL search with
+ * component decomposition, component caching and clause learning, in
+ * the style of sharpSAT. Variables are numbered from 1 as in the DIMACS
+ * format; variables with a weight are those of the inputs, with that
+ * probability; other variables (those of the Tseytin transformation)
+ * are functionally determined by the inputs and are only decided upon
+ * when no input is left in a component. */
+class DPLLCompiler {
+ private:
+  static constexpr unsigned NO_REASON = UINT_MAX;
+  static constexpr unsigned MAX_LEARNED = 100000;
+  static constexpr size_t MAX_CACHE = 1000000;
+
+  const unsigned nb_vars;
+  const std::vector<double> &weights;
+  std::vector<std::vector<int>> clauses;
+  unsigned nb_original;
+  std::vector<std::vector<unsigned>> watches;
+
+  std::vector<signed char> value;
+  std::vector<unsigned> level;
+  std::vector<unsigned> reason;
+  std::vector<int> trail;
+  size_t propagated;
+  unsigned current_level;
+
+  std::vector<unsigned> parent;
+  std::vector<unsigned> stamp;
+  unsigned current_stamp;
+  std::vector<unsigned> score;
+
+  BooleanCircuit *dnnf;
+  unsigned false_gate;
+  std::vector<unsigned> leaves;
+  std::unordered_map<std::string, unsigned> cache;
+  std::vector<std::string> cache_log;
+
+  static unsigned index(int lit) { return 2*abs(lit) + (lit<0); }
+  bool isTrue(int lit) const { return value[abs(lit)] == (lit>0); }
+  bool isFalse(int lit) const { return value[abs(lit)] == (lit<0); }
+
+  void assign(int lit, unsigned r);
+  unsigned propagate();
+  void learn(unsigned conflict);
+  void backtrack(size_t trail_size);
+  void addWatchedClause(std::vector<int> &&c);
+
+  unsigned leaf(int lit);
+  std::vector<std::pair<std::vector<unsigned>,std::vector<unsigned>>> components(const std::vector<unsigned> &clause_ids);
+  unsigned compileBranch(int lit, const std::vector<unsigned> &clause_ids, const std::vector<unsigned> &vars);
+  unsigned compileComponent(const std::vector<unsigned> &clause_ids, const std::vector<unsigned> &vars);
+
+ public:
+  DPLLCompiler(unsigned nb_vars, const std::vector<std::vector<int>> &clauses, const std::vector<double> &weights);
+
+  /* Adds to d the gates of a d-DNNF equivalent to the CNF, the
+   * probability of which is given by d.dDNNFEvaluation, and returns its
+   * root */
+  unsigned compile(BooleanCircuit &d);
+
+  /* Literals of the leaves of the d-DNNF built by compile, by gate */
+  std::unordered_map<unsigned, int> literals() const;
+};
+
+#endif /* DPLL_COMPILER_H */
@@ -0,0 +1,102 @@
+#include "TreeDecomposition.h"
+#include "Circuit.h"
+
+extern "C" {
+#include "provsql_utils.h"
+}
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <queue>
+#include <string>
+#include <unordered_set>
+
+using namespace std;
+
+TreeDecomposition::TreeDecomposition(unsigned n, const vector<vector<unsigned>> &hyperedges, unsigned max_width) :
+  position(n), bags(n), tw(0)
+{
+  assert(max_width <= MAX_WIDTH);
+
+  vector<unordered_set<unsigned>> adjacency(n);
+  for(const auto &e : hyperedges)
+    for(auto u : e)
+      for(auto v : e)
+        if(u != v)
+          adjacency[u].insert(v);
+
+  // Vertices whose degree exceeds max_width cannot be eliminated yet;
+  // their fill is not computed
+  const unsigned long long infinity = ULLONG_MAX;
+  auto score = [&](unsigned v) -> unsigned long long {
+    const auto &a = adjacency[v];
+    if(a.size() > max_width)
+      return infinity;
+
+    unsigned long long fill = 0;
+    for(auto it = a.begin(); it != a.end(); ++it)
+      for(auto jt = next(it); jt != a.end(); ++jt)
+        if(adjacency[*it].find(*jt) == adjacency[*it].end())
+          ++fill;
+
+    return fill * (max_width+1) + a.size();
+  };
+
+  // Lazy priority queue: entries whose score is outdated are skipped
+  using entry = pair<unsigned long long, unsigned>;
+  priority_queue<entry, vector<entry>, greater<entry>> queue;
+  vector<unsigned long long> current(n);
+  vector<bool> eliminated(n);
+  for(unsigned v=0; v<n; ++v) {
+    current[v] = score(v);
+    queue.push({current[v], v});
+  }
+
+  while(order.size() < n) {
+    const entry e = queue.top();
+    queue.pop();
+    const unsigned v = e.second;
+    if(eliminated[v] || e.first != current[v])
+      continue;
+
+    if(e.first == infinity)
+      throw CircuitException("Treewidth larger than "+to_string(max_width));
+
+    if(provsql_interrupted)
+      throw CircuitException("Interrupted");
+
+    position[v] = order.size();
+    order.push_back(v);
+    eliminated[v] = true;
+
+    const vector<unsigned> neighbours(adjacency[v].begin(), adjacency[v].end());
+    bags[v].push_back(v);
+    bags[v].insert(bags[v].end(), neighbours.begin(), neighbours.end());
+    tw = max(tw, (unsigned) neighbours.size());
+
+    for(auto u : neighbours) {
+      adjacency[u].erase(v);
+      for(auto w : neighbours)
+        if(u != w)
+          adjacency[u].insert(w);
+    }
+    adjacency[v].clear();
+
+    // Only the scores of the neighbours are updated, which makes
+    // min-fill approximate but keeps each elimination cheap
+    for(auto u : neighbours) {
+      current[u] = score(u);
+      queue.push({current[u], u});
+    }
+  }
+}
+
+unsigned TreeDecomposition::parent(unsigned v) const
+{
+  unsigned result = v;
+  for(size_t i=1; i<bags[v].size(); ++i)
+    if(result == v || position[bags[v][i]] < position[result])
+      result = bags[v][i];
+  return result;
+}
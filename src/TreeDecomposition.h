@@ -0,0 +1,37 @@
+#ifndef TREE_DECOMPOSITION_H
+#define TREE_DECOMPOSITION_H
+
+#include <vector>
+
+/* Tree decomposition of a graph, given by the hyperedges (cliques) that
+ * cover it, obtained from an elimination ordering chosen by the min-fill
+ * heuristic, ties being broken by minimal degree. The bag of vertex v
+ * is v together with its neighbours when it is eliminated; its parent is
+ * the bag of the first of these neighbours to be eliminated afterwards.
+ * An exception is thrown as soon as a bag would exceed max_width+1
+ * vertices, so that callers can fall back on another method; max_width
+ * is at most MAX_WIDTH, callers materializing a table of 2^(w+1)
+ * entries for bags of w+1 vertices. */
+class TreeDecomposition {
+ private:
+  std::vector<unsigned> order;
+  std::vector<unsigned> position;
+  std::vector<std::vector<unsigned>> bags;
+  unsigned tw;
+
+ public:
+  static const unsigned MAX_WIDTH = 30;
+
+  TreeDecomposition(unsigned nb_vertices, const std::vector<std::vector<unsigned>> &hyperedges, unsigned max_width);
+
+  const std::vector<unsigned> &eliminationOrder() const { return order; }
+  /* Rank of v in the elimination ordering */
+  unsigned rank(unsigned v) const { return position[v]; }
+  /* Bag of v, starting with v */
+  const std::vector<unsigned> &bag(unsigned v) const { return bags[v]; }
+  /* Vertex whose bag is the parent of that of v, or v for a root */
+  unsigned parent(unsigned v) const;
+  unsigned width() const { return tw; }
+};
+
+#endif /* TREE_DECOMPOSITION_H */
@@ -1,4 +1,5 @@
 #include "WhereCircuit.h"
+#include "provsql_utils_cpp.h"
 
 extern "C" {
 #include "provsql_utils.h"
@@ -47,7 +48,7 @@ string WhereCircuit::toString(unsigned g) const
 
   switch(gates[g]) {
     case WhereGate::IN:
-      return input_info.find(g)->second.first+":"+to_string(input_info.find(g)->second.second)+":"+input_token.find(g)->second;
+      return input_info.find(g)->second.first+":"+to_string(input_info.find(g)->second.second)+":"+UUID2string(input_token.find(g)->second);
     case WhereGate::UNDETERMINED:
       op="?";
       break;
@@ -182,5 +183,5 @@ bool WhereCircuit::Locator::operator<(WhereCircuit::Locator that) const
 
 std::string WhereCircuit::Locator::toString() const
 {
-  return table + ":" + tid + ":" +to_string(position);
+  return table + ":" + UUID2string(tid) + ":" +to_string(position);
 }
@@ -0,0 +1,70 @@
+#ifndef XOSHIRO256_H
+#define XOSHIRO256_H
+
+#include <cstdint>
+
+// xoshiro256** pseudo-random number generator, by David Blackman and
+// Sebastiano Vigna (http://prng.di.unimi.it/): much faster than rand(),
+// with 64 bits of output per call
+class Xoshiro256 {
+ private:
+  uint64_t s[4];
+
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+ public:
+  // The state is initialized from the seed with splitmix64, as
+  // recommended by the authors
+  explicit Xoshiro256(uint64_t seed) {
+    for(auto &x : s) {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      x = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t operator()() {
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+  }
+
+  // Advances the state by 2^128 calls: the generators obtained from the
+  // same seed by 0, 1, 2... jumps produce non-overlapping streams
+  void jump() {
+    static const uint64_t JUMP[] = {
+      0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+      0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t t[4] = {0, 0, 0, 0};
+
+    for(auto j : JUMP)
+      for(int b=0; b<64; ++b) {
+        if(j & (1ULL << b))
+          for(int i=0; i<4; ++i)
+            t[i] ^= s[i];
+        (*this)();
+      }
+
+    for(int i=0; i<4; ++i)
+      s[i] = t[i];
+  }
+
+  // Uniform double in [0,1)
+  double uniform() {
+    return ((*this)() >> 11) * (1. / 9007199254740992.);
+  }
+};
+
+#endif /* XOSHIRO256_H */
@@ -0,0 +1,165 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/uuid.h"
+
+#include "provsql_utils.h"
+#include "circuit_storage.h"
+
+/* Access to the provenance circuit from SQL, independently of the way
+ * it is stored */
+
+PG_FUNCTION_INFO_V1(create_gate);
+PG_FUNCTION_INFO_V1(get_gate_type);
+PG_FUNCTION_INFO_V1(get_children);
+PG_FUNCTION_INFO_V1(sub_circuit);
+PG_FUNCTION_INFO_V1(invalidate_circuit_cache);
+
+Datum create_gate(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+  char *type;
+  int i;
+
+  if(PG_ARGISNULL(0) || PG_ARGISNULL(1))
+    elog(ERROR, "create_gate: NULL argument");
+
+  token = PG_GETARG_UUID_P(0);
+  type = DatumGetCString(DirectFunctionCall1(enum_out, PG_GETARG_DATUM(1)));
+
+  for(i=0; i<nb_gate_types; ++i)
+    if(!strcmp(type, gate_type_name[i]))
+      break;
+  if(i == nb_gate_types)
+    elog(ERROR, "create_gate: unknown gate type %s", type);
+
+  circuit_add_gate(token, (gate_type) i);
+
+  if(!PG_ARGISNULL(2)) {
+    Datum *children;
+    bool *nulls;
+    int nb, j;
+
+    deconstruct_array(PG_GETARG_ARRAYTYPE_P(2), UUIDOID, UUID_LEN, false, 'c',
+                      &children, &nulls, &nb);
+    for(j=0; j<nb; ++j) {
+      if(nulls[j])
+        elog(ERROR, "create_gate: NULL child");
+      circuit_add_wire(token, DatumGetUUIDP(children[j]), j+1);
+    }
+  }
+
+  circuit_flush_if_needed();
+
+  PG_RETURN_VOID();
+}
+
+Datum get_gate_type(PG_FUNCTION_ARGS)
+{
+  circuit_gate gate;
+
+  if(PG_ARGISNULL(0) || !circuit_get_gate(PG_GETARG_UUID_P(0), &gate))
+    PG_RETURN_NULL();
+
+  PG_RETURN_DATUM(DirectFunctionCall2(enum_in,
+                                      CStringGetDatum(gate_type_name[gate.type]),
+                                      ObjectIdGetDatum(get_func_rettype(fcinfo->flinfo->fn_oid))));
+}
+
+Datum get_children(PG_FUNCTION_ARGS)
+{
+  circuit_gate gate;
+  Datum *children;
+  unsigned i;
+
+  if(PG_ARGISNULL(0) || !circuit_get_gate(PG_GETARG_UUID_P(0), &gate))
+    PG_RETURN_NULL();
+
+  if(gate.nb_children == 0)
+    PG_RETURN_ARRAYTYPE_P(construct_empty_array(UUIDOID));
+
+  children = (Datum *) palloc(gate.nb_children * sizeof(Datum));
+  for(i=0; i<gate.nb_children; ++i)
+    children[i] = UUIDPGetDatum(&gate.children[i]);
+
+  PG_RETURN_ARRAYTYPE_P(construct_array(children, gate.nb_children, UUIDOID,
+                                        UUID_LEN, false, 'c'));
+}
+
+typedef struct sub_circuit_state {
+  circuit_gate *gates;
+  unsigned nb_gates;
+  unsigned gate;   /* Current gate */
+  unsigned child;  /* Next child of the current gate */
+  Oid gate_type_oid;
+} sub_circuit_state;
+
+/* One row (f, t, gate_type) per wire of the sub-circuit rooted at the
+ * token, and one row (f, NULL, gate_type) per gate without children;
+ * each gate is visited once, however many times it is shared */
+Datum sub_circuit(PG_FUNCTION_ARGS)
+{
+  FuncCallContext *funcctx;
+  sub_circuit_state *state;
+
+  if(SRF_IS_FIRSTCALL()) {
+    MemoryContext oldcontext;
+    TupleDesc tupdesc;
+
+    funcctx = SRF_FIRSTCALL_INIT();
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      elog(ERROR, "sub_circuit: return type must be a row type");
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+    state = (sub_circuit_state *) palloc(sizeof(sub_circuit_state));
+    state->gates = circuit_sub_circuit(PG_GETARG_UUID_P(0), &state->nb_gates);
+    state->gate = 0;
+    state->child = 0;
+    state->gate_type_oid = TupleDescAttr(tupdesc, 2)->atttypid;
+    funcctx->user_fctx = state;
+
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  state = (sub_circuit_state *) funcctx->user_fctx;
+
+  if(state->gate < state->nb_gates) {
+    circuit_gate *g = &state->gates[state->gate];
+    Datum values[3];
+    bool nulls[3] = {false, false, false};
+
+    values[0] = UUIDPGetDatum(&g->token);
+    if(g->nb_children == 0)
+      nulls[1] = true;
+    else
+      values[1] = UUIDPGetDatum(&g->children[state->child]);
+    values[2] = DirectFunctionCall2(enum_in,
+                                    CStringGetDatum(gate_type_name[g->type]),
+                                    ObjectIdGetDatum(state->gate_type_oid));
+
+    if(++state->child >= g->nb_children) {
+      ++state->gate;
+      state->child = 0;
+    }
+
+    SRF_RETURN_NEXT(funcctx,
+                    HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+  }
+
+  SRF_RETURN_DONE(funcctx);
+}
+
+Datum invalidate_circuit_cache(PG_FUNCTION_ARGS)
+{
+  circuit_cache_invalidate();
+
+  PG_RETURN_VOID();
+}
@@ -0,0 +1,962 @@
+#include "postgres.h"
+#include "access/xact.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "lib/ilist.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+#include "circuit_storage.h"
+#include "shared_circuit.h"
+
+const char *gate_type_name[] = {
+  "input", "plus", "times", "monus", "monusl",
+  "monusr", "project", "zero", "one", "eq"
+};
+
+typedef struct buffered_gate {
+  pg_uuid_t token;
+  gate_type type;
+} buffered_gate;
+
+typedef struct buffered_wire {
+  pg_uuid_t f;
+  pg_uuid_t t;
+  int idx;
+  int position;  /* Of f in the buffered gates, -1 if not buffered */
+} buffered_wire;
+
+typedef struct buffered_extra {
+  pg_uuid_t gate;
+  int position;  /* Of gate in the buffered gates, -1 if not buffered */
+  int info1;
+  int info2;
+  bool info1_isnull;
+  bool info2_isnull;
+} buffered_extra;
+
+/* Index of the buffered gates; a gate that is buffered a second time
+ * is ignored, together with the wires and extra information that
+ * follow it */
+typedef struct buffered_gate_entry {
+  pg_uuid_t token;  /* Hash key, must be first */
+  int position;
+  bool accept;      /* Whether wires from this gate are still expected */
+} buffered_gate_entry;
+
+typedef struct circuit_buffer {
+  HTAB *index;
+  buffered_gate *gates;
+  unsigned nb_gates, max_gates;
+  buffered_wire *wires;
+  unsigned nb_wires, max_wires;
+  buffered_extra *extra;
+  unsigned nb_extra, max_extra;
+} circuit_buffer;
+
+static MemoryContext buffer_context = NULL;
+static circuit_buffer buffer;
+
+/* A single statement inserts all buffered gates, and the wires and
+ * extra information of the gates that were actually inserted; gates
+ * that already exist are silently skipped. No table lock is needed:
+ * when two backends create the same gate, the second one waits on the
+ * primary key for the first one to finish, and then inserts nothing
+ * (or everything, if the first one aborted). Gates are inserted in
+ * token order, so that two single flushes never wait on each other in
+ * opposite orders. A transaction usually inserts gates in several
+ * statements, or flushes, however, and keeps the gates it has inserted
+ * locked until it ends: two concurrent transactions creating common
+ * gates in different statements can thus deadlock, and one of them is
+ * then aborted by PostgreSQL's deadlock detection. */
+static const char *flush_query =
+  "WITH g AS ("
+  "  INSERT INTO provsql.provenance_circuit_gate"
+  "    SELECT * FROM unnest($1, $2::provsql.provenance_gate[]) AS n(gate, gate_type)"
+  "    ORDER BY gate"
+  "  ON CONFLICT DO NOTHING RETURNING gate"
+  "), w AS ("
+  "  INSERT INTO provsql.provenance_circuit_wire"
+  "    SELECT w.f, w.t, w.idx FROM unnest($3, $4, $5) AS w(f, t, idx)"
+  "    JOIN g ON g.gate=w.f"
+  ") "
+  "INSERT INTO provsql.provenance_circuit_extra"
+  "  SELECT e.gate, e.info1, e.info2"
+  "  FROM unnest($6, $7, $8) AS e(gate, info1, info2)"
+  "  JOIN g ON g.gate=e.gate";
+
+static SPIPlanPtr flush_plan = NULL;
+
+static SPIPlanPtr get_type_plan = NULL;
+static SPIPlanPtr get_children_plan = NULL;
+static SPIPlanPtr get_extra_plan = NULL;
+
+static SPIPlanPtr level_type_plan = NULL;
+static SPIPlanPtr level_children_plan = NULL;
+static SPIPlanPtr level_extra_plan = NULL;
+
+bool circuit_storage_shared(void)
+{
+  if(provsql_circuit_storage != CIRCUIT_STORAGE_SHARED_MEMORY)
+    return false;
+
+  if(!shared_circuit_available())
+    ereport(ERROR,
+            (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+             errmsg("shared-memory circuit storage is not available"),
+             errhint("provsql must be loaded through shared_preload_libraries.")));
+
+  return true;
+}
+
+/* Returns array, grown if needed so that it can hold at least nb+1
+ * elements of size elem_size */
+static void *ensure_capacity(void *array, unsigned nb, unsigned *max, Size elem_size)
+{
+  if(buffer_context == NULL)
+    buffer_context = AllocSetContextCreate(TopMemoryContext,
+                                           "ProvSQL circuit buffer",
+                                           ALLOCSET_DEFAULT_MINSIZE,
+                                           ALLOCSET_DEFAULT_INITSIZE,
+                                           ALLOCSET_DEFAULT_MAXSIZE);
+
+  if(nb < *max)
+    return array;
+
+  *max = *max ? 2 * *max : 16;
+
+  if(array)
+    return repalloc(array, *max * elem_size);
+  else
+    return MemoryContextAlloc(buffer_context, *max * elem_size);
+}
+
+static HTAB *buffer_index(void)
+{
+  if(buffer.index == NULL) {
+    HASHCTL ctl;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(pg_uuid_t);
+    ctl.entrysize = sizeof(buffered_gate_entry);
+    ctl.hcxt = buffer_context;
+    buffer.index = hash_create("ProvSQL buffered gates", 1024, &ctl,
+                               HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+  }
+
+  return buffer.index;
+}
+
+/* Position of the buffered gate token, or -1 if it is not buffered or
+ * no longer accepts wires */
+static int accepting_position(const pg_uuid_t *token)
+{
+  buffered_gate_entry *entry;
+
+  if(buffer.index == NULL)
+    return -1;
+
+  entry = (buffered_gate_entry *) hash_search(buffer.index, token, HASH_FIND, NULL);
+
+  if(entry == NULL)
+    return -1;
+  else if(!entry->accept)
+    return -2;
+  else
+    return entry->position;
+}
+
+static void reset_buffer(void)
+{
+  buffer.nb_gates = buffer.nb_wires = buffer.nb_extra = 0;
+
+  if(buffer.index) {
+    hash_destroy(buffer.index);
+    buffer.index = NULL;
+  }
+}
+
+void circuit_add_gate(const pg_uuid_t *token, gate_type type)
+{
+  buffered_gate *g;
+  buffered_gate_entry *entry;
+  bool found;
+
+  buffer.gates = ensure_capacity(buffer.gates, buffer.nb_gates, &buffer.max_gates, sizeof(buffered_gate));
+
+  entry = (buffered_gate_entry *) hash_search(buffer_index(), token, HASH_ENTER, &found);
+  if(found) {
+    entry->accept = false;
+    return;
+  }
+  entry->position = buffer.nb_gates;
+  entry->accept = true;
+
+  g = &buffer.gates[buffer.nb_gates++];
+  g->token = *token;
+  g->type = type;
+}
+
+void circuit_add_wire(const pg_uuid_t *f, const pg_uuid_t *t, int idx)
+{
+  buffered_wire *w;
+  int position = accepting_position(f);
+
+  if(position == -2)
+    return;
+
+  buffer.wires = ensure_capacity(buffer.wires, buffer.nb_wires, &buffer.max_wires, sizeof(buffered_wire));
+  w = &buffer.wires[buffer.nb_wires++];
+  w->f = *f;
+  w->t = *t;
+  w->idx = idx;
+  w->position = position;
+}
+
+void circuit_add_extra(const pg_uuid_t *gate,
+                       int info1, bool info1_isnull,
+                       int info2, bool info2_isnull)
+{
+  buffered_extra *e;
+  int position = accepting_position(gate);
+
+  if(position == -2)
+    return;
+
+  buffer.extra = ensure_capacity(buffer.extra, buffer.nb_extra, &buffer.max_extra, sizeof(buffered_extra));
+  e = &buffer.extra[buffer.nb_extra++];
+  e->gate = *gate;
+  e->position = position;
+  e->info1 = info1;
+  e->info2 = info2;
+  e->info1_isnull = info1_isnull;
+  e->info2_isnull = info2_isnull;
+}
+
+static ArrayType *make_array(Datum *elems, bool *nulls, int nb, Oid elemtype)
+{
+  int dims[1] = {nb};
+  int lbs[1] = {1};
+  int16 typlen;
+  bool typbyval;
+  char typalign;
+
+  if(nb == 0)
+    return construct_empty_array(elemtype);
+
+  get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+
+  return construct_md_array(elems, nulls, 1, dims, lbs, elemtype, typlen, typbyval, typalign);
+}
+
+/* Gates are written one at a time to shared memory, together with
+ * their children and extra information, grouped by gate with a
+ * counting sort; input gates are implicit */
+static void flush_shared(unsigned nb_gates, unsigned nb_wires, unsigned nb_extra)
+{
+  unsigned *first_child = (unsigned *) palloc0((nb_gates+1) * sizeof(unsigned));
+  unsigned *first_extra = (unsigned *) palloc0((nb_gates+1) * sizeof(unsigned));
+  unsigned *next = (unsigned *) palloc((nb_gates+1) * sizeof(unsigned));
+  pg_uuid_t *children = (pg_uuid_t *) palloc((nb_wires+1) * sizeof(pg_uuid_t));
+  int *extra = (int *) palloc((2*nb_extra+1) * sizeof(int));
+  unsigned i;
+
+  for(i=0; i<nb_wires; ++i)
+    if(buffer.wires[i].position >= 0)
+      ++first_child[buffer.wires[i].position+1];
+  for(i=0; i<nb_gates; ++i)
+    first_child[i+1] += first_child[i];
+  memcpy(next, first_child, nb_gates * sizeof(unsigned));
+  for(i=0; i<nb_wires; ++i)
+    if(buffer.wires[i].position >= 0)
+      children[next[buffer.wires[i].position]++] = buffer.wires[i].t;
+
+  for(i=0; i<nb_extra; ++i)
+    if(buffer.extra[i].position >= 0)
+      ++first_extra[buffer.extra[i].position+1];
+  for(i=0; i<nb_gates; ++i)
+    first_extra[i+1] += first_extra[i];
+  memcpy(next, first_extra, nb_gates * sizeof(unsigned));
+  for(i=0; i<nb_extra; ++i)
+    if(buffer.extra[i].position >= 0) {
+      buffered_extra *e = &buffer.extra[i];
+      unsigned k = next[e->position]++;
+      extra[2*k] = e->info1_isnull ? 0 : e->info1;
+      extra[2*k+1] = e->info2_isnull ? 0 : e->info2;
+    }
+
+  for(i=0; i<nb_gates; ++i) {
+    if(buffer.gates[i].type == gate_input)
+      continue;
+
+    shared_circuit_add_gate(&buffer.gates[i].token, buffer.gates[i].type,
+                            first_child[i+1] - first_child[i], children + first_child[i],
+                            first_extra[i+1] - first_extra[i], extra + 2 * first_extra[i]);
+  }
+
+  pfree(first_child);
+  pfree(first_extra);
+  pfree(next);
+  pfree(children);
+  pfree(extra);
+}
+
+void circuit_flush(void)
+{
+  constants_t constants;
+  Datum arguments[8];
+  Datum *d1, *d2, *d3;
+  bool *n3;
+  unsigned nb_gates=buffer.nb_gates, nb_wires=buffer.nb_wires, nb_extra=buffer.nb_extra;
+  unsigned i;
+  HeapTuple tuple;
+  Oid owner, save_userid;
+  int save_sec_context;
+
+  if(nb_gates == 0)
+    return;
+
+  if(circuit_storage_shared()) {
+    reset_buffer();
+    flush_shared(nb_gates, nb_wires, nb_extra);
+    return;
+  }
+
+  if(!initialize_constants(&constants)) {
+    elog(ERROR, "Cannot find provsql schema");
+  }
+
+  /* The buffer is emptied before anything that might fail, so that
+   * an error does not leave stale gates to be inserted later on */
+  reset_buffer();
+
+  d1 = (Datum *) palloc(nb_gates * sizeof(Datum));
+  d2 = (Datum *) palloc(nb_gates * sizeof(Datum));
+  for(i=0; i<nb_gates; ++i) {
+    d1[i] = UUIDPGetDatum(&buffer.gates[i].token);
+    d2[i] = CStringGetTextDatum(gate_type_name[buffer.gates[i].type]);
+  }
+  arguments[0] = PointerGetDatum(make_array(d1, NULL, nb_gates, UUIDOID));
+  arguments[1] = PointerGetDatum(make_array(d2, NULL, nb_gates, TEXTOID));
+
+  d1 = (Datum *) palloc((nb_wires+1) * sizeof(Datum));
+  d2 = (Datum *) palloc((nb_wires+1) * sizeof(Datum));
+  d3 = (Datum *) palloc((nb_wires+1) * sizeof(Datum));
+  n3 = (bool *) palloc((nb_wires+1) * sizeof(bool));
+  for(i=0; i<nb_wires; ++i) {
+    d1[i] = UUIDPGetDatum(&buffer.wires[i].f);
+    d2[i] = UUIDPGetDatum(&buffer.wires[i].t);
+    d3[i] = Int32GetDatum(buffer.wires[i].idx);
+    n3[i] = buffer.wires[i].idx == 0;
+  }
+  arguments[2] = PointerGetDatum(make_array(d1, NULL, nb_wires, UUIDOID));
+  arguments[3] = PointerGetDatum(make_array(d2, NULL, nb_wires, UUIDOID));
+  arguments[4] = PointerGetDatum(make_array(d3, n3, nb_wires, INT4OID));
+
+  d1 = (Datum *) palloc((nb_extra+1) * sizeof(Datum));
+  d2 = (Datum *) palloc((nb_extra+1) * sizeof(Datum));
+  d3 = (Datum *) palloc((nb_extra+1) * sizeof(Datum));
+  n3 = (bool *) palloc((2*nb_extra+1) * sizeof(bool));
+  for(i=0; i<nb_extra; ++i) {
+    d1[i] = UUIDPGetDatum(&buffer.extra[i].gate);
+    d2[i] = Int32GetDatum(buffer.extra[i].info1);
+    d3[i] = Int32GetDatum(buffer.extra[i].info2);
+    n3[i] = buffer.extra[i].info1_isnull;
+    n3[nb_extra+i] = buffer.extra[i].info2_isnull;
+  }
+  arguments[5] = PointerGetDatum(make_array(d1, NULL, nb_extra, UUIDOID));
+  arguments[6] = PointerGetDatum(make_array(d2, n3, nb_extra, INT4OID));
+  arguments[7] = PointerGetDatum(make_array(d3, n3+nb_extra, nb_extra, INT4OID));
+
+  /* Buffered gates are inserted outside of the SECURITY DEFINER gate
+   * creation functions, so the insertion runs as the owner of the
+   * provsql schema, as these functions would. The previous user is
+   * restored by the transaction abort if the insertion fails. */
+  tuple = SearchSysCache1(NAMESPACEOID, ObjectIdGetDatum(constants.OID_SCHEMA_PROVSQL));
+  if(!HeapTupleIsValid(tuple))
+    elog(ERROR, "Cannot find provsql schema");
+  owner = ((Form_pg_namespace) GETSTRUCT(tuple))->nspowner;
+  ReleaseSysCache(tuple);
+
+  GetUserIdAndSecContext(&save_userid, &save_sec_context);
+  SetUserIdAndSecContext(owner, save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+  SPI_connect();
+
+  if(flush_plan == NULL) {
+    Oid argtypes[8] = {
+      constants.OID_TYPE_UUID_ARRAY, TEXTARRAYOID,
+      constants.OID_TYPE_UUID_ARRAY, constants.OID_TYPE_UUID_ARRAY, constants.OID_TYPE_INT_ARRAY,
+      constants.OID_TYPE_UUID_ARRAY, constants.OID_TYPE_INT_ARRAY, constants.OID_TYPE_INT_ARRAY
+    };
+
+    SPIPlanPtr plan = SPI_prepare(flush_query, 8, argtypes);
+    if(plan == NULL)
+      elog(ERROR, "Cannot prepare insertion of gates into the provenance circuit");
+    SPI_keepplan(plan);
+    flush_plan = plan;
+  }
+
+  if(SPI_execute_plan(flush_plan, arguments, NULL, false, 0) != SPI_OK_INSERT)
+    elog(ERROR, "Cannot insert gates into the provenance circuit");
+
+  SPI_finish();
+
+  SetUserIdAndSecContext(save_userid, save_sec_context);
+}
+
+void circuit_flush_if_needed(void)
+{
+  if(!provsql_defer_gate_insertion ||
+     !provsql_shared_library_loaded ||
+     buffer.nb_gates >= (unsigned) provsql_gate_buffer_size)
+    circuit_flush();
+}
+
+/* Gates of the circuit read by circuit_sub_circuit are kept in a
+ * backend-local cache, bounded by provsql.circuit_cache_size and
+ * evicted in least-recently-used order, so that evaluating the
+ * provenance of many tuples with overlapping sub-circuits only reads
+ * each gate once. Gates never change once created; they can only be
+ * deleted, by trim_circuit, which increments a generation counter in
+ * shared memory, causing every backend to drop its cache. Without this
+ * counter, i.e., when provsql is not in shared_preload_libraries, the
+ * cache is disabled. */
+typedef struct cached_gate {
+  pg_uuid_t token;  /* Hash key, must be first */
+  gate_type type;
+  unsigned nb_children;
+  pg_uuid_t *children;
+  unsigned nb_extra;
+  int *extra;
+  Size size;
+  dlist_node lru;   /* Most recently used first */
+} cached_gate;
+
+static pg_atomic_uint32 *circuit_generation = NULL;
+static uint32 cache_generation = 0;
+static bool generation_bump_pending = false;
+
+static MemoryContext cache_context = NULL;
+static HTAB *cache = NULL;
+static dlist_head cache_lru;
+static Size cache_size = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static void circuit_storage_shmem_startup(void)
+{
+  bool found;
+
+  if(prev_shmem_startup_hook)
+    prev_shmem_startup_hook();
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  circuit_generation = ShmemInitStruct("provsql circuit generation",
+                                       sizeof(pg_atomic_uint32), &found);
+  if(!found)
+    pg_atomic_init_u32(circuit_generation, 0);
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void circuit_storage_request(void)
+{
+  RequestAddinShmemSpace(sizeof(pg_atomic_uint32));
+
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = circuit_storage_shmem_startup;
+
+  if(provsql_circuit_storage == CIRCUIT_STORAGE_SHARED_MEMORY)
+    shared_circuit_request();
+}
+
+void circuit_storage_unregister(void)
+{
+  if(shmem_startup_hook == circuit_storage_shmem_startup)
+    shmem_startup_hook = prev_shmem_startup_hook;
+  shared_circuit_unregister();
+}
+
+static void cache_reset(void)
+{
+  if(cache_context != NULL)
+    MemoryContextReset(cache_context);
+  cache = NULL;
+  cache_size = 0;
+}
+
+static void bump_generation(void)
+{
+  if(circuit_generation != NULL)
+    pg_atomic_fetch_add_u32(circuit_generation, 1);
+  cache_reset();
+}
+
+void circuit_cache_invalidate(void)
+{
+  /* Other backends may cache gates that are about to be deleted until
+   * the deletion is committed, so the counter is incremented again at
+   * commit */
+  bump_generation();
+  generation_bump_pending = true;
+}
+
+/* Returns whether the cache can be used, dropping its content if the
+ * circuit was trimmed since it was filled */
+static bool cache_enabled(void)
+{
+  uint32 generation;
+
+  if(circuit_generation == NULL || provsql_circuit_cache_size == 0)
+    return false;
+
+  generation = pg_atomic_read_u32(circuit_generation);
+  if(generation != cache_generation) {
+    cache_reset();
+    cache_generation = generation;
+  }
+
+  if(cache == NULL) {
+    HASHCTL ctl;
+
+    if(cache_context == NULL)
+      cache_context = AllocSetContextCreate(TopMemoryContext,
+                                            "ProvSQL circuit cache",
+                                            ALLOCSET_DEFAULT_MINSIZE,
+                                            ALLOCSET_DEFAULT_INITSIZE,
+                                            ALLOCSET_DEFAULT_MAXSIZE);
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(pg_uuid_t);
+    ctl.entrysize = sizeof(cached_gate);
+    ctl.hcxt = cache_context;
+    cache = hash_create("ProvSQL circuit cache", 1024, &ctl,
+                        HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+    dlist_init(&cache_lru);
+  }
+
+  return true;
+}
+
+/* Fills gate, whose token is set, from the cache; children and extra
+ * are palloc'd copies */
+static bool cache_get(circuit_gate *gate)
+{
+  cached_gate *c = (cached_gate *) hash_search(cache, &gate->token, HASH_FIND, NULL);
+
+  if(c == NULL)
+    return false;
+
+  dlist_move_head(&cache_lru, &c->lru);
+
+  gate->type = c->type;
+  gate->nb_children = c->nb_children;
+  gate->children = (pg_uuid_t *) palloc((c->nb_children + 1) * sizeof(pg_uuid_t));
+  memcpy(gate->children, c->children, c->nb_children * sizeof(pg_uuid_t));
+  gate->nb_extra = c->nb_extra;
+  gate->extra = (int *) palloc((2 * c->nb_extra + 1) * sizeof(int));
+  memcpy(gate->extra, c->extra, 2 * c->nb_extra * sizeof(int));
+
+  return true;
+}
+
+static void cache_put(const circuit_gate *gate)
+{
+  Size limit = (Size) provsql_circuit_cache_size * 1024;
+  cached_gate *c;
+  bool found;
+
+  c = (cached_gate *) hash_search(cache, &gate->token, HASH_ENTER, &found);
+  if(found)
+    return;
+
+  c->type = gate->type;
+  c->nb_children = gate->nb_children;
+  c->children = (pg_uuid_t *) MemoryContextAlloc(cache_context,
+                                                 (gate->nb_children + 1) * sizeof(pg_uuid_t));
+  memcpy(c->children, gate->children, gate->nb_children * sizeof(pg_uuid_t));
+  c->nb_extra = gate->nb_extra;
+  c->extra = (int *) MemoryContextAlloc(cache_context,
+                                        (2 * gate->nb_extra + 1) * sizeof(int));
+  memcpy(c->extra, gate->extra, 2 * gate->nb_extra * sizeof(int));
+  c->size = sizeof(cached_gate) + (gate->nb_children + 1) * sizeof(pg_uuid_t) +
+    (2 * gate->nb_extra + 1) * sizeof(int);
+
+  dlist_push_head(&cache_lru, &c->lru);
+  cache_size += c->size;
+
+  while(cache_size > limit) {
+    cached_gate *last = dlist_container(cached_gate, lru, dlist_tail_node(&cache_lru));
+
+    dlist_delete(&last->lru);
+    cache_size -= last->size;
+    pfree(last->children);
+    pfree(last->extra);
+    hash_search(cache, &last->token, HASH_REMOVE, NULL);
+  }
+}
+
+/* Deferred gates are written before the transaction commits, and
+ * forgotten if it aborts */
+static void circuit_xact_callback(XactEvent event, void *arg)
+{
+  switch(event) {
+    case XACT_EVENT_PRE_COMMIT:
+    case XACT_EVENT_PRE_PREPARE:
+      circuit_flush();
+      break;
+    case XACT_EVENT_COMMIT:
+      if(generation_bump_pending) {
+        bump_generation();
+        generation_bump_pending = false;
+      }
+      break;
+    case XACT_EVENT_ABORT:
+      reset_buffer();
+      generation_bump_pending = false;
+      break;
+    default:
+      break;
+  }
+}
+
+void circuit_storage_init(void)
+{
+  RegisterXactCallback(circuit_xact_callback, NULL);
+}
+
+static gate_type gate_type_from_name(const char *name)
+{
+  int i;
+
+  for(i=0; i<nb_gate_types; ++i)
+    if(!strcmp(name, gate_type_name[i]))
+      return (gate_type) i;
+
+  elog(ERROR, "Unknown gate type: %s", name);
+  return nb_gate_types; /* not reached */
+}
+
+static void execute_gate_query(SPIPlanPtr *plan, const char *query, const pg_uuid_t *token)
+{
+  Datum arguments[1] = {UUIDPGetDatum(token)};
+
+  if(*plan == NULL) {
+    Oid argtypes[1] = {UUIDOID};
+    SPIPlanPtr p = SPI_prepare(query, 1, argtypes);
+    if(p == NULL)
+      elog(ERROR, "Cannot prepare retrieval of gates from the provenance circuit");
+    SPI_keepplan(p);
+    *plan = p;
+  }
+
+  if(SPI_execute_plan(*plan, arguments, NULL, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "Cannot retrieve gates from the provenance circuit");
+}
+
+static bool table_get_gate(const pg_uuid_t *token, circuit_gate *gate)
+{
+  bool isnull;
+  unsigned i;
+
+  SPI_connect();
+
+  execute_gate_query(&get_type_plan,
+                     "SELECT gate_type::text FROM provsql.provenance_circuit_gate WHERE gate=$1",
+                     token);
+  if(SPI_processed == 0) {
+    SPI_finish();
+    return false;
+  }
+  gate->type = gate_type_from_name(SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1));
+
+  execute_gate_query(&get_children_plan,
+                     "SELECT t FROM provsql.provenance_circuit_wire WHERE f=$1 ORDER BY idx",
+                     token);
+  gate->nb_children = SPI_processed;
+  gate->children = (pg_uuid_t *) SPI_palloc((SPI_processed+1) * sizeof(pg_uuid_t));
+  for(i=0; i<SPI_processed; ++i)
+    gate->children[i] = *DatumGetUUIDP(SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull));
+
+  execute_gate_query(&get_extra_plan,
+                     "SELECT info1, info2 FROM provsql.provenance_circuit_extra WHERE gate=$1",
+                     token);
+  gate->nb_extra = SPI_processed;
+  gate->extra = (int *) SPI_palloc((2*SPI_processed+1) * sizeof(int));
+  for(i=0; i<SPI_processed; ++i) {
+    Datum info = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull);
+    gate->extra[2*i] = isnull ? 0 : DatumGetInt32(info);
+    info = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 2, &isnull);
+    gate->extra[2*i+1] = isnull ? 0 : DatumGetInt32(info);
+  }
+
+  SPI_finish();
+
+  return true;
+}
+
+bool circuit_get_gate(const pg_uuid_t *token, circuit_gate *gate)
+{
+  if(&gate->token != token)
+    gate->token = *token;
+
+  circuit_flush();
+
+  if(!circuit_storage_shared())
+    return table_get_gate(token, gate);
+
+  if(!shared_circuit_get_gate(token, &gate->type,
+                              &gate->nb_children, &gate->children,
+                              &gate->nb_extra, &gate->extra)) {
+    /* Tokens unknown to the shared-memory storage are input gates,
+     * except for the constant gates */
+    if(provsql_uuid_equal(token, provsql_gate_zero()))
+      gate->type = gate_zero;
+    else if(provsql_uuid_equal(token, provsql_gate_one()))
+      gate->type = gate_one;
+    else
+      gate->type = gate_input;
+    gate->nb_children = 0;
+    gate->children = NULL;
+    gate->nb_extra = 0;
+    gate->extra = NULL;
+  }
+
+  return true;
+}
+
+/* Position of each gate of the sub-circuit in the result of
+ * circuit_sub_circuit */
+typedef struct visited_gate {
+  pg_uuid_t token;  /* Hash key, must be first */
+  unsigned position;
+  bool stored;      /* Whether the gate was found, in the cache or in storage */
+} visited_gate;
+
+/* Adds token to the sub-circuit being built if it was not visited
+ * yet, taking it from the cache if use_cache is set and it is there */
+static void visit(HTAB *visited, const pg_uuid_t *token, bool use_cache,
+                  circuit_gate **result, unsigned *nb, unsigned *max)
+{
+  bool found;
+  visited_gate *v = (visited_gate *) hash_search(visited, token, HASH_ENTER, &found);
+  circuit_gate *g;
+
+  if(found)
+    return;
+
+  if(*nb == *max) {
+    *max *= 2;
+    *result = (circuit_gate *) repalloc(*result, *max * sizeof(circuit_gate));
+  }
+
+  v->position = *nb;
+  g = &(*result)[(*nb)++];
+  g->token = *token;
+  v->stored = use_cache && cache_get(g);
+
+  if(!v->stored) {
+    /* Gates that are not stored can only be input gates */
+    g->type = gate_input;
+    g->nb_children = 0;
+    g->children = NULL;
+    g->nb_extra = 0;
+    g->extra = NULL;
+  }
+}
+
+static visited_gate *visited_at(HTAB *visited, Datum token)
+{
+  return (visited_gate *) hash_search(visited, DatumGetUUIDP(token), HASH_FIND, NULL);
+}
+
+static void execute_level_query(SPIPlanPtr *plan, const char *query, Datum tokens)
+{
+  Datum arguments[1] = {tokens};
+
+  if(*plan == NULL) {
+    constants_t constants;
+    Oid argtypes[1];
+    SPIPlanPtr p;
+
+    if(!initialize_constants(&constants))
+      elog(ERROR, "Cannot find provsql schema");
+    argtypes[0] = constants.OID_TYPE_UUID_ARRAY;
+
+    p = SPI_prepare(query, 1, argtypes);
+    if(p == NULL)
+      elog(ERROR, "Cannot prepare retrieval of gates from the provenance circuit");
+    SPI_keepplan(p);
+    *plan = p;
+  }
+
+  if(SPI_execute_plan(*plan, arguments, NULL, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "Cannot retrieve gates from the provenance circuit");
+}
+
+/* Retrieves from the tables the gates of result between positions
+ * start and end that were not found in the cache, all at once */
+static void table_sub_circuit_level(HTAB *visited, bool use_cache,
+                                    circuit_gate *result,
+                                    unsigned start, unsigned end)
+{
+  Datum *tokens = (Datum *) palloc((end - start) * sizeof(Datum));
+  unsigned *queried = (unsigned *) palloc((end - start) * sizeof(unsigned));
+  unsigned nb_queried = 0;
+  Datum array;
+  HeapTuple tuple;
+  TupleDesc tupdesc;
+  visited_gate *v;
+  circuit_gate *g;
+  bool isnull;
+  unsigned i, j, k;
+  unsigned nb_wires;
+  pg_uuid_t *children;
+
+  for(i=start; i<end; ++i)
+    if(!visited_at(visited, UUIDPGetDatum(&result[i].token))->stored) {
+      tokens[nb_queried] = UUIDPGetDatum(&result[i].token);
+      queried[nb_queried++] = i;
+    }
+
+  if(nb_queried == 0)
+    return;
+
+  array = PointerGetDatum(construct_array(tokens, nb_queried, UUIDOID, UUID_LEN, false, 'c'));
+
+  SPI_connect();
+
+  execute_level_query(&level_type_plan,
+                      "SELECT gate, gate_type::text FROM provsql.provenance_circuit_gate"
+                      " WHERE gate = ANY($1)",
+                      array);
+  tupdesc = SPI_tuptable->tupdesc;
+  for(i=0; i<SPI_processed; ++i) {
+    tuple = SPI_tuptable->vals[i];
+    v = visited_at(visited, SPI_getbinval(tuple, tupdesc, 1, &isnull));
+    v->stored = true;
+    result[v->position].type = gate_type_from_name(SPI_getvalue(tuple, tupdesc, 2));
+  }
+
+  /* Wires of a same gate are consecutive, in the order of their idx */
+  execute_level_query(&level_children_plan,
+                      "SELECT f, t FROM provsql.provenance_circuit_wire"
+                      " WHERE f = ANY($1) ORDER BY f, idx",
+                      array);
+  tupdesc = SPI_tuptable->tupdesc;
+  nb_wires = SPI_processed;
+  children = (pg_uuid_t *) SPI_palloc((nb_wires+1) * sizeof(pg_uuid_t));
+  for(i=0; i<nb_wires; i=j) {
+    g = &result[visited_at(visited, SPI_getbinval(SPI_tuptable->vals[i], tupdesc, 1, &isnull))->position];
+    g->children = children + i;
+    for(j=i; j<nb_wires; ++j) {
+      tuple = SPI_tuptable->vals[j];
+      if(!provsql_uuid_equal(DatumGetUUIDP(SPI_getbinval(tuple, tupdesc, 1, &isnull)), &g->token))
+        break;
+      children[j] = *DatumGetUUIDP(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+    }
+    g->nb_children = j-i;
+  }
+
+  execute_level_query(&level_extra_plan,
+                      "SELECT gate, info1, info2 FROM provsql.provenance_circuit_extra"
+                      " WHERE gate = ANY($1) ORDER BY gate",
+                      array);
+  tupdesc = SPI_tuptable->tupdesc;
+  for(i=0; i<SPI_processed; i=j) {
+    g = &result[visited_at(visited, SPI_getbinval(SPI_tuptable->vals[i], tupdesc, 1, &isnull))->position];
+    for(j=i; j<SPI_processed; ++j)
+      if(!provsql_uuid_equal(DatumGetUUIDP(SPI_getbinval(SPI_tuptable->vals[j], tupdesc, 1, &isnull)), &g->token))
+        break;
+    g->nb_extra = j-i;
+    g->extra = (int *) SPI_palloc(2 * (j-i) * sizeof(int));
+    for(k=i; k<j; ++k) {
+      Datum info;
+      tuple = SPI_tuptable->vals[k];
+      info = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+      g->extra[2*(k-i)] = isnull ? 0 : DatumGetInt32(info);
+      info = SPI_getbinval(tuple, tupdesc, 3, &isnull);
+      g->extra[2*(k-i)+1] = isnull ? 0 : DatumGetInt32(info);
+    }
+  }
+
+  SPI_finish();
+
+  if(use_cache)
+    for(i=0; i<nb_queried; ++i)
+      if(visited_at(visited, tokens[i])->stored)
+        cache_put(&result[queried[i]]);
+
+  pfree(tokens);
+  pfree(queried);
+}
+
+circuit_gate *circuit_sub_circuit(const pg_uuid_t *root, unsigned *nb_gates)
+{
+  return circuit_sub_circuits(root, 1, nb_gates);
+}
+
+circuit_gate *circuit_sub_circuits(const pg_uuid_t *roots, unsigned nb_roots,
+                                   unsigned *nb_gates)
+{
+  HASHCTL ctl;
+  HTAB *visited;
+  circuit_gate *result;
+  unsigned nb = 0, max = 16, i, j, k;
+  bool shared = circuit_storage_shared();
+  bool use_cache = cache_enabled();
+
+  circuit_flush();
+
+  memset(&ctl, 0, sizeof(ctl));
+  ctl.keysize = sizeof(pg_uuid_t);
+  ctl.entrysize = sizeof(visited_gate);
+  ctl.hcxt = CurrentMemoryContext;
+  visited = hash_create("ProvSQL visited gates", 256, &ctl,
+                        HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+  result = (circuit_gate *) palloc(max * sizeof(circuit_gate));
+  for(i=0; i<nb_roots; ++i)
+    visit(visited, &roots[i], use_cache, &result, &nb, &max);
+
+  /* result is also used as the queue of the breadth-first traversal;
+   * each gate is retrieved exactly once, even when it is shared by
+   * several gates of the sub-circuit. With table storage, there is one
+   * round of queries per level of the traversal. */
+  for(i=0; i<nb; i=j) {
+    j = nb;
+
+    if(shared) {
+      for(k=i; k<j; ++k)
+        if(!visited_at(visited, UUIDPGetDatum(&result[k].token))->stored) {
+          circuit_get_gate(&result[k].token, &result[k]);
+          /* Input gates are not stored in shared memory */
+          if(use_cache && result[k].type != gate_input)
+            cache_put(&result[k]);
+        }
+    } else
+      table_sub_circuit_level(visited, use_cache, result, i, j);
+
+    /* result may be moved when children are added */
+    for(k=i; k<j; ++k) {
+      unsigned c;
+      for(c=0; c<result[k].nb_children; ++c)
+        visit(visited, &result[k].children[c], use_cache, &result, &nb, &max);
+    }
+  }
+
+  hash_destroy(visited);
+
+  *nb_gates = nb;
+  return result;
+}
@@ -0,0 +1,75 @@
+#ifndef CIRCUIT_STORAGE_H
+#define CIRCUIT_STORAGE_H
+
+#include "provsql_utils.h"
+
+/* Types of gates of a provenance circuit, in the same order as in the
+ * provenance_gate enum type */
+typedef enum gate_type {
+  gate_input, gate_plus, gate_times, gate_monus, gate_monusl,
+  gate_monusr, gate_project, gate_zero, gate_one, gate_eq,
+  nb_gate_types
+} gate_type;
+
+extern const char *gate_type_name[];
+
+/* Whether the circuit is stored in shared memory rather than in the
+ * provenance_circuit_* tables, as set by provsql.circuit_storage */
+bool circuit_storage_shared(void);
+
+/* Gates, wires and extra information are accumulated in a buffer and
+ * only written to the circuit by circuit_flush. Wires and extra
+ * information are only written for gates that did not already exist,
+ * so that the creation of a gate is idempotent. An idx of 0 for a wire
+ * stands for a NULL idx. */
+void circuit_add_gate(const pg_uuid_t *token, gate_type type);
+void circuit_add_wire(const pg_uuid_t *f, const pg_uuid_t *t, int idx);
+void circuit_add_extra(const pg_uuid_t *gate,
+                       int info1, bool info1_isnull,
+                       int info2, bool info2_isnull);
+void circuit_flush(void);
+
+/* To be called once gates have been added: flushes the buffer, unless
+ * provsql.defer_gate_insertion is set and the buffer holds fewer than
+ * provsql.gate_buffer_size gates. Deferred gates are flushed at the end
+ * of each statement (from the ExecutorEnd hook), before the circuit is
+ * read, and before commit. */
+void circuit_flush_if_needed(void);
+
+/* To be called from _PG_init */
+void circuit_storage_init(void);
+
+/* To be called from _PG_init, while shared_preload_libraries are being
+ * processed, and from _PG_fini */
+void circuit_storage_request(void);
+void circuit_storage_unregister(void);
+
+/* To be called when gates are deleted from the circuit: drops the
+ * cache of gates of all backends */
+void circuit_cache_invalidate(void);
+
+/* A gate of the circuit, as retrieved from storage: extra is an array
+ * of nb_extra pairs (info1, info2), NULL information being
+ * represented by 0 */
+typedef struct circuit_gate {
+  pg_uuid_t token;
+  gate_type type;
+  unsigned nb_children;
+  pg_uuid_t *children;
+  unsigned nb_extra;
+  int *extra;
+} circuit_gate;
+
+/* Returns false if the gate is unknown */
+bool circuit_get_gate(const pg_uuid_t *token, circuit_gate *gate);
+
+/* All gates reachable from root, root included, each of them once;
+ * the result is palloc'd */
+circuit_gate *circuit_sub_circuit(const pg_uuid_t *root, unsigned *nb_gates);
+
+/* All gates reachable from any of the nb_roots roots, each of them
+ * once */
+circuit_gate *circuit_sub_circuits(const pg_uuid_t *roots, unsigned nb_roots,
+                                   unsigned *nb_gates);
+
+#endif /* CIRCUIT_STORAGE_H */
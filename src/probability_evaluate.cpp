@@ -4,14 +4,32 @@ extern "C" {
 #include "catalog/pg_type.h"
 #include "utils/uuid.h"
 #include "executor/spi.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "provsql_utils.h"
+#include "circuit_storage.h"
+#include "miscadmin.h"
+#include <sys/stat.h>
   
   PG_FUNCTION_INFO_V1(probability_evaluate);
+  PG_FUNCTION_INFO_V1(probability_evaluate_batch);
+  PG_FUNCTION_INFO_V1(circuit_stats);
 }
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
 #include <csignal>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 
 #include "BooleanCircuit.h"
+#include "TreeDecomposition.h"
 #include "provsql_utils_cpp.h"
 
 using namespace std;
@@ -21,82 +39,327 @@ static void provsql_sigint_handler (int)
   provsql_interrupted = true;
 }
 
-static Datum probability_evaluate_internal
-  (Datum token, Datum token2prob, const string &method, const string &args)
+/* Reads the union of the sub-circuits rooted at tokens, whatever the
+ * storage of the circuit; without token2prob (InvalidOid), inputs are
+ * given probability 0.5 */
+static void load_circuit(BooleanCircuit &c, const vector<Datum> &tokens, Datum token2prob)
 {
-  constants_t constants;
-  if(!initialize_constants(&constants)) {
-    elog(ERROR, "Cannot find provsql schema");
+  vector<pg_uuid_t> roots;
+  for(auto t : tokens)
+    roots.push_back(*DatumGetUUIDP(t));
+
+  unsigned nb_gates;
+  circuit_gate *gates = circuit_sub_circuits(roots.data(), roots.size(), &nb_gates);
+  vector<Datum> inputs;
+
+  for(unsigned i=0; i<nb_gates; ++i) {
+    const pg_uuid_t &f = gates[i].token;
+    unsigned id;
+
+    switch(gates[i].type) {
+      case gate_input:
+        if(token2prob == ObjectIdGetDatum(InvalidOid))
+          c.setGate(f, BooleanGate::IN, 0.5);
+        else
+          inputs.push_back(UUIDPGetDatum(&gates[i].token));
+        continue;
+      case gate_monus:
+      case gate_monusl:
+      case gate_times:
+      case gate_project:
+      case gate_eq:
+      case gate_one:
+        id = c.setGate(f, BooleanGate::AND);
+        break;
+      case gate_plus:
+      case gate_zero:
+        id = c.setGate(f, BooleanGate::OR);
+        break;
+      case gate_monusr:
+        id = c.setGate(f, BooleanGate::NOT);
+        break;
+      default:
+        elog(ERROR, "Wrong type of gate in circuit");
+    }
+
+    for(unsigned j=0; j<gates[i].nb_children; ++j)
+      c.addWire(id, c.getGate(gates[i].children[j]));
   }
 
-  Datum arguments[2]={token,token2prob};
-  Oid argtypes[2]={constants.OID_TYPE_PROVENANCE_TOKEN,REGCLASSOID};
-  char nulls[2] = {' ',' '};
-  
-  SPI_connect();
-
-  BooleanCircuit c;
-
-  if(SPI_execute_with_args(
-      "SELECT * FROM provsql.sub_circuit_with_prob($1,$2)", 2, argtypes, arguments, nulls, true, 0)
-      == SPI_OK_SELECT) {
-    int proc = SPI_processed;
-    TupleDesc tupdesc = SPI_tuptable->tupdesc;
-    SPITupleTable *tuptable = SPI_tuptable;
-
-    for (int i = 0; i < proc; i++)
-    {
-      HeapTuple tuple = tuptable->vals[i];
-
-      string f = SPI_getvalue(tuple, tupdesc, 1);
-      string type = SPI_getvalue(tuple, tupdesc, 3);
-      if(type == "input") {
-        c.setGate(f, BooleanGate::IN, stod(SPI_getvalue(tuple, tupdesc, 4)));
-      } else {
-        unsigned id=c.getGate(f);
-
-        if(type == "monus" || type == "monusl" || type == "times" || type=="project" || type=="eq") {
-          c.setGate(f, BooleanGate::AND);
-        } else if(type == "plus") {
-          c.setGate(f, BooleanGate::OR);
-        } else if(type == "monusr") {
-          c.setGate(f, BooleanGate::NOT);
-        } else {
-          elog(ERROR, "Wrong type of gate in circuit");
-        }
-        c.addWire(id, c.getGate(SPI_getvalue(tuple, tupdesc, 2)));
-      }
+  for(auto &p : readMapping(token2prob, inputs))
+    c.setGate(p.first, BooleanGate::IN, stod(p.second));
+}
+
+/* Arguments of a method, separated by ';' */
+static vector<string> split_arguments(const string &args)
+{
+  vector<string> result;
+  stringstream ss(args);
+  string x;
+
+  while(getline(ss, x, ';'))
+    result.push_back(x);
+  if(result.empty())
+    result.push_back(string());
+
+  return result;
+}
+
+/* Seed given as n-th argument of a sampling method, or a random seed if
+ * there is none */
+static uint64_t seed_argument(const vector<string> &a, unsigned n)
+{
+  if(a.size()<=n || a[n].empty())
+    return ((uint64_t) rand() << 32) ^ rand();
+
+  try {
+    return stoull(a[n]);
+  } catch(std::logic_error &e) {
+    elog(ERROR, "Invalid seed: '%s'", a[n].c_str());
+  }
+
+  return 0;
+}
+
+/* Arguments of methods with a relative error guarantee: the relative
+ * error and the probability of exceeding it, optionally followed by a
+ * seed, separated by ';' */
+static void relative_error_arguments(const string &method, const string &args,
+                                     double &epsilon, double &delta, uint64_t &seed)
+{
+  vector<string> a = split_arguments(args);
+  epsilon = delta = 0.;
+
+  try {
+    if(a.size()==2 || a.size()==3) {
+      epsilon = stod(a[0]);
+      delta = stod(a[1]);
     }
+  } catch(std::logic_error &e) {
   }
 
-  SPI_finish();
+  if(!(epsilon>0. && epsilon<1. && delta>0. && delta<1.))
+    elog(ERROR, "Invalid arguments for method %s: '%s' (expected 'epsilon;delta')",
+         method.c_str(), args.c_str());
 
-// Display the circuit for debugging:
-// elog(WARNING, "%s", c.toString(c.getGate(UUIDDatum2string(token))).c_str());
+  seed = seed_argument(a, 2);
+}
+
+/* Budgets of the auto method: exact methods are only used when the
+ * estimated number of operations they need is at most AUTO_MAX_COST,
+ * with tree decompositions of width at most AUTO_MAX_WIDTH and BDDs of
+ * at most AUTO_MAX_NODES nodes and AUTO_MAX_MEMORY bytes; otherwise,
+ * karp-luby is run with AUTO_EPSILON and AUTO_DELTA, or monte-carlo
+ * with AUTO_SAMPLES samples */
+static const double AUTO_MAX_COST = 1e9;
+static const unsigned AUTO_MAX_WIDTH = 20;
+static const size_t AUTO_MAX_NODES = 1000000, AUTO_MAX_MEMORY = 256 << 20;
+static const double AUTO_EPSILON = 0.05, AUTO_DELTA = 0.05;
+static const unsigned AUTO_SAMPLES = 100000;
+
+/* Method chosen by auto for a circuit of statistics s: the cheapest of
+ * possible-worlds, which enumerates worlds in Gray code order so that
+ * each of them only updates part of the circuit, and tree-decomposition,
+ * if one of them fits the budget, bdd otherwise */
+static string auto_method(const BooleanCircuit::Statistics &s)
+{
+  const double size = s.gates + s.wires;
+  const double worlds = s.inputs < 64 ?
+    ldexp(size / max(s.inputs, 1ul), s.inputs) : HUGE_VAL;
+  const double td = s.width <= AUTO_MAX_WIDTH ?
+    ldexp(size, s.width+1) : HUGE_VAL;
+
+  if(min(worlds, td) > AUTO_MAX_COST)
+    return "bdd";
+  return worlds <= td ? "possible-worlds" : "tree-decomposition";
+}
+
+/* Probability of g by the auto method: the method chosen by
+ * auto_method, bdd falling back on an approximate method when it
+ * exceeds its budget: karp-luby for DNFs, monte-carlo otherwise */
+static double auto_evaluate(BooleanCircuit &c, unsigned g, uint64_t seed)
+{
+  const BooleanCircuit::Statistics s = c.statistics(g, AUTO_MAX_WIDTH);
+  const string method = auto_method(s);
+
+  if(method == "possible-worlds")
+    return c.independentComponents(g, [&](unsigned h) {
+      return c.possibleWorlds(h, provsql_probability_threads);
+    });
+  if(method == "tree-decomposition")
+    return c.independentComponents(g, [&](unsigned h) {
+      return c.treeDecompositionEvaluation(h, AUTO_MAX_WIDTH);
+    });
+
+  try {
+    return c.independentComponents(g, [&](unsigned h) {
+      return c.BDDEvaluation(h, AUTO_MAX_NODES, AUTO_MAX_MEMORY);
+    });
+  } catch(CircuitException &e) {
+    if(provsql_interrupted)
+      throw;
+  }
 
-  double result;
-  unsigned gate = c.getGate(UUIDDatum2string(token));
+  if(s.dnf)
+    return c.KarpLuby(g, AUTO_EPSILON, AUTO_DELTA, seed);
+  else
+    return c.monteCarlo(g, AUTO_SAMPLES, seed, provsql_probability_threads);
+}
+
+/* Minimization of the roots of c that are DNFs of at most
+ * MINIMIZE_MAX_CLAUSES clauses, before and after receiving the total
+ * numbers of clauses */
+static const unsigned long MINIMIZE_MAX_CLAUSES = 100000;
+
+static void minimize_roots(BooleanCircuit &c, vector<unsigned> &roots,
+                           unsigned long &before, unsigned long &after)
+{
+  before = after = 0;
+
+  try {
+    for(auto &gate : roots) {
+      unsigned long b, a;
+      gate = c.minimizeDNF(gate, MINIMIZE_MAX_CLAUSES, b, a);
+      before += b;
+      after += a;
+    }
+  } catch(CircuitException &e) {
+    elog(ERROR, "%s", e.what());
+  }
+}
+
+/* Probabilities of the gates roots of c; methods other than
+ * monte-carlo ones are run separately for each root, and exact methods
+ * for each of the sub-circuits of a root that share no input. The
+ * circuit is first simplified, and its read-once parts evaluated
+ * exactly, so that methods only deal with the rest, and are not run at
+ * all if nothing remains. */
+static vector<double> probability_evaluate_internal
+  (BooleanCircuit &c, vector<unsigned> roots, const string &method, const string &args)
+{
+  static const set<string> methods = {
+    "monte-carlo", "monte-carlo-adaptive", "karp-luby", "bdd", "tree-decomposition",
+    "possible-worlds", "compilation", "weightmc", "auto"
+  };
+  vector<double> result;
+
+  if(methods.find(method) == methods.end())
+    elog(ERROR, "Wrong method '%s' for probability evaluation", method.c_str());
 
   provsql_interrupted = false;
 
   void (*prev_sigint_handler)(int);
   prev_sigint_handler = signal(SIGINT, provsql_sigint_handler);
 
-  if(method=="monte-carlo") {
+  roots = c.simplify(roots);
+
+  if(provsql_minimize_dnf) {
+    unsigned long before, after;
+    minimize_roots(c, roots, before, after);
+    elog(NOTICE, "DNF minimization: %lu clauses reduced to %lu", before, after);
+  }
+
+  if(c.evaluateIndependent(roots, result)) {
+    // Nothing left for the method
+  } else if(method=="monte-carlo") {
+    // Arguments are the number of samples, optionally followed by a
+    // seed, separated by ';'
+    vector<string> a = split_arguments(args);
     int samples;
     bool invalid=false;
 
     try {
-      samples = stoi(args);
+      samples = stoi(a[0]);
     } catch(std::invalid_argument &e) {
       invalid=true;
     }
 
-    if(invalid || samples==0 || samples<0)
+    if(a.size()>2 || invalid || samples==0 || samples<0)
       elog(ERROR, "Invalid number of samples: '%s'", args.c_str());
+
+    uint64_t seed = seed_argument(a, 1);
     
     try {
-      result = c.monteCarlo(gate, samples);
+      result = c.monteCarlo(roots, samples, seed, provsql_probability_threads);
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+  } else if(method=="monte-carlo-adaptive") {
+    double epsilon, delta;
+    uint64_t seed;
+    relative_error_arguments(method, args, epsilon, delta, seed);
+
+    vector<unsigned long long> samples;
+    vector<bool> capped;
+
+    try {
+      result = c.monteCarloAdaptive(roots, epsilon, delta, seed, samples, capped);
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+
+    if(!samples.empty())
+      elog(NOTICE, "monte-carlo-adaptive: %llu samples used",
+           *max_element(samples.begin(), samples.end()));
+    if(find(capped.begin(), capped.end(), true) != capped.end())
+      elog(NOTICE, "monte-carlo-adaptive: sample limit reached, absolute error at most %.2g "
+           "instead of relative error %g", sqrt(epsilon*epsilon*epsilon/8), epsilon);
+  } else if(method=="karp-luby") {
+    double epsilon, delta;
+    uint64_t seed;
+    relative_error_arguments(method, args, epsilon, delta, seed);
+
+    try {
+      for(auto gate : roots)
+        result.push_back(c.KarpLuby(gate, epsilon, delta, seed));
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+  } else if(method=="bdd") {
+    // Optional arguments are the maximum number of nodes of the BDD and
+    // the maximum memory it uses, in kB, separated by ';'
+    vector<string> a = split_arguments(args);
+    unsigned long long max_nodes = 10000000, max_memory = 1048576;
+
+    try {
+      if(a.size()>2)
+        throw std::invalid_argument(args);
+      if(!a[0].empty())
+        max_nodes = stoull(a[0]);
+      if(a.size()>1 && !a[1].empty())
+        max_memory = stoull(a[1]);
+    } catch(std::logic_error &e) {
+      elog(ERROR, "Invalid arguments for method bdd: '%s' (expected 'max_nodes;max_memory')", args.c_str());
+    }
+
+    try {
+      for(auto gate : roots)
+        result.push_back(c.independentComponents(gate, [&](unsigned h) {
+          return c.BDDEvaluation(h, max_nodes, max_memory*1024);
+        }));
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+  } else if(method=="tree-decomposition") {
+    // Optional argument is the maximum width of the tree decomposition
+    unsigned long max_width = 20;
+
+    try {
+      if(!args.empty()) {
+        size_t end;
+        max_width = stoul(args, &end);
+        if(end != args.size() || max_width > TreeDecomposition::MAX_WIDTH)
+          throw std::invalid_argument(args);
+      }
+    } catch(std::logic_error &e) {
+      elog(ERROR, "Invalid argument for method tree-decomposition: '%s' (expected 'max_width')", args.c_str());
+    }
+
+    try {
+      for(auto gate : roots)
+        result.push_back(c.independentComponents(gate, [&](unsigned h) {
+          return c.treeDecompositionEvaluation(h, max_width);
+        }));
     } catch(CircuitException &e) {
       elog(ERROR, "%s", e.what());
     }
@@ -105,30 +368,66 @@ static Datum probability_evaluate_internal
       elog(WARNING, "Argument '%s' ignored for method possible-worlds", args.c_str());
 
     try {
-      result = c.possibleWorlds(gate);
+      for(auto gate : roots)
+        result.push_back(c.independentComponents(gate, [&](unsigned h) {
+          return c.possibleWorlds(h, provsql_probability_threads);
+        }));
     } catch(CircuitException &e) {
       elog(ERROR, "%s", e.what());
     }
   } else if(method=="compilation") {
+    string store;
+    if(provsql_store_compiled_circuits) {
+      store = string(DataDir)+"/provsql_compiled";
+      if(mkdir(store.c_str(), S_IRWXU) && errno != EEXIST)
+        elog(ERROR, "Cannot create directory %s: %m", store.c_str());
+    }
+
+    try {
+      for(auto gate : roots)
+        result.push_back(c.independentComponents(gate, [&](unsigned h) {
+          return c.compilation(h, args, store);
+        }));
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+  } else if(method=="auto") {
+    // Optional argument is the seed of approximate methods
+    vector<string> a = split_arguments(args);
+    if(a.size()>1)
+      elog(ERROR, "Invalid argument for method auto: '%s' (expected 'seed')", args.c_str());
+    uint64_t seed = seed_argument(a, 0);
+
     try {
-      result = c.compilation(gate, args);
+      for(auto gate : roots)
+        result.push_back(auto_evaluate(c, gate, seed));
     } catch(CircuitException &e) {
       elog(ERROR, "%s", e.what());
     }
   } else if(method=="weightmc") {
     try {
-	    result = c.WeightMC(gate, args);
+      for(auto gate : roots)
+        result.push_back(c.independentComponents(gate, [&](unsigned h) {
+          return c.WeightMC(h, args);
+        }));
     } catch(CircuitException &e) {
-	    elog(ERROR, "%s", e.what());
+      elog(ERROR, "%s", e.what());
     }
-  } else {
-    elog(ERROR, "Wrong method '%s' for probability evaluation", method.c_str());
   }
 
   provsql_interrupted = false;
   signal (SIGINT, prev_sigint_handler);
   
-  PG_RETURN_FLOAT8(result);
+  return result;
+}
+
+static string text_argument(FunctionCallInfo fcinfo, int n)
+{
+  if(PG_ARGISNULL(n))
+    return string();
+
+  text *t = PG_GETARG_TEXT_P(n);
+  return string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
 }
 
 Datum probability_evaluate(PG_FUNCTION_ARGS)
@@ -136,27 +435,173 @@ Datum probability_evaluate(PG_FUNCTION_ARGS)
   try {
     Datum token = PG_GETARG_DATUM(0);
     Datum token2prob = PG_GETARG_DATUM(1);
-    string method;
-    string args;
+    string method = text_argument(fcinfo, 2);
+    string args = text_argument(fcinfo, 3);
+
+    if(PG_ARGISNULL(1))
+      PG_RETURN_NULL();
+
+    BooleanCircuit c;
+    load_circuit(c, {token}, token2prob);
+
+// Display the circuit for debugging:
+// elog(WARNING, "%s", c.toString(c.getGate(*DatumGetUUIDP(token))).c_str());
+
+    vector<double> result = probability_evaluate_internal(
+        c, {c.getGate(*DatumGetUUIDP(token))}, method, args);
+
+    PG_RETURN_FLOAT8(result[0]);
+  } catch(const std::exception &e) {
+    elog(ERROR, "probability_evaluate: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "probability_evaluate: Unknown exception");
+  }
+
+  PG_RETURN_NULL();
+}
+
+typedef struct batch_state {
+  Datum *tokens;
+  bool *nulls;
+  double *probabilities;
+  int nb;
+} batch_state;
+
+/* Probabilities of all tokens of an array, computed on a single circuit
+ * holding all their sub-circuits: this circuit is read once, and
+ * monte-carlo samples are shared by all tokens */
+Datum probability_evaluate_batch(PG_FUNCTION_ARGS)
+{
+  try {
+    FuncCallContext *funcctx;
+    batch_state *state;
+
+    if(SRF_IS_FIRSTCALL()) {
+      funcctx = SRF_FIRSTCALL_INIT();
+      MemoryContext oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-    if(!PG_ARGISNULL(2)) {
-      text *t = PG_GETARG_TEXT_P(2);
-      method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      TupleDesc tupdesc;
+      if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        elog(ERROR, "probability_evaluate_batch: return type must be a row type");
+      funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+      state = (batch_state *) palloc(sizeof(batch_state));
+      state->nb = 0;
+      funcctx->user_fctx = state;
+
+      if(!PG_ARGISNULL(0) && !PG_ARGISNULL(1)) {
+        deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), UUIDOID, UUID_LEN, false, 'c',
+                          &state->tokens, &state->nulls, &state->nb);
+        state->probabilities = (double *) palloc(state->nb * sizeof(double));
+
+        vector<Datum> tokens;
+        for(int i=0; i<state->nb; ++i)
+          if(!state->nulls[i])
+            tokens.push_back(state->tokens[i]);
+
+        BooleanCircuit c;
+        load_circuit(c, tokens, PG_GETARG_DATUM(1));
+
+        vector<unsigned> roots;
+        for(auto t : tokens)
+          roots.push_back(c.getGate(*DatumGetUUIDP(t)));
+
+        vector<double> result = probability_evaluate_internal(
+            c, roots, text_argument(fcinfo, 2), text_argument(fcinfo, 3));
+
+        for(int i=0, k=0; i<state->nb; ++i)
+          if(!state->nulls[i])
+            state->probabilities[i] = result[k++];
+      }
+
+      MemoryContextSwitchTo(oldcontext);
     }
 
-    if(!PG_ARGISNULL(3)) {
-      text *t = PG_GETARG_TEXT_P(3);
-      args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+    funcctx = SRF_PERCALL_SETUP();
+    state = (batch_state *) funcctx->user_fctx;
+
+    if(funcctx->call_cntr < (unsigned) state->nb) {
+      unsigned i = funcctx->call_cntr;
+      Datum values[2];
+      bool nulls[2] = {state->nulls[i], state->nulls[i]};
+
+      values[0] = state->tokens[i];
+      values[1] = state->nulls[i] ? (Datum) 0 : Float8GetDatum(state->probabilities[i]);
+
+      SRF_RETURN_NEXT(funcctx,
+                      HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
     }
 
-    if(PG_ARGISNULL(1))
+    SRF_RETURN_DONE(funcctx);
+  } catch(const std::exception &e) {
+    elog(ERROR, "probability_evaluate_batch: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "probability_evaluate_batch: Unknown exception");
+  }
+
+  PG_RETURN_NULL();
+}
+
+/* Statistics of the circuit of a token, as seen by the auto method of
+ * probability evaluation, and the method it would choose: the circuit
+ * is prepared as by probability_evaluate_internal, and its read-once
+ * parts are replaced by inputs, except for the fraction of read-once
+ * gates, which is that of the circuit before this replacement */
+Datum circuit_stats(PG_FUNCTION_ARGS)
+{
+  try {
+    if(PG_ARGISNULL(0))
       PG_RETURN_NULL();
 
-    return probability_evaluate_internal(token, token2prob, method, args);
+    Datum token = PG_GETARG_DATUM(0);
+    Datum token2prob = PG_ARGISNULL(1) ? ObjectIdGetDatum(InvalidOid) : PG_GETARG_DATUM(1);
+
+    TupleDesc tupdesc;
+    if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+      elog(ERROR, "circuit_stats: return type must be a row type");
+    tupdesc = BlessTupleDesc(tupdesc);
+
+    BooleanCircuit c;
+    load_circuit(c, {token}, token2prob);
+
+    vector<unsigned> roots = c.simplify({c.getGate(*DatumGetUUIDP(token))});
+    if(provsql_minimize_dnf) {
+      unsigned long before, after;
+      minimize_roots(c, roots, before, after);
+    }
+    const unsigned g = roots[0];
+    BooleanCircuit::Statistics s;
+    string method;
+
+    try {
+      const double read_once = c.statistics(g, AUTO_MAX_WIDTH).read_once;
+
+      // Read-once parts are evaluated before the method is chosen
+      vector<double> result;
+      const bool evaluated = c.evaluateIndependent({g}, result);
+      s = c.statistics(g, AUTO_MAX_WIDTH);
+      s.read_once = read_once;
+      method = evaluated ? "read-once" : auto_method(s);
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+
+    Datum values[7];
+    bool nulls[7] = {false, false, false, false, false, s.width > AUTO_MAX_WIDTH, false};
+
+    values[0] = Int64GetDatum(s.gates);
+    values[1] = Int64GetDatum(s.inputs);
+    values[2] = Int32GetDatum(s.depth);
+    values[3] = BoolGetDatum(s.dnf);
+    values[4] = Float8GetDatum(s.read_once);
+    values[5] = Int32GetDatum(s.width);
+    values[6] = CStringGetTextDatum(method.c_str());
+
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
   } catch(const std::exception &e) {
-    elog(ERROR, "probability_evaluate: %s", e.what());
+    elog(ERROR, "circuit_stats: %s", e.what());
   } catch(...) {
-    elog(ERROR, "probability_evaluate: Unknown exception");
+    elog(ERROR, "circuit_stats: Unknown exception");
   }
 
   PG_RETURN_NULL();
@@ -0,0 +1,280 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "utils/uuid.h"
+
+#include "provsql_utils.h"
+#include "circuit_storage.h"
+
+PG_FUNCTION_INFO_V1(provenance_times);
+PG_FUNCTION_INFO_V1(provenance_plus);
+PG_FUNCTION_INFO_V1(provenance_monus);
+PG_FUNCTION_INFO_V1(provenance_project);
+PG_FUNCTION_INFO_V1(provenance_eq);
+
+/* Tokens of gates are computed exactly as the former PL/pgSQL
+ * implementation of these functions did with
+ * uuid_generate_v5(uuid_ns_provsql(), ...), so that gates created by
+ * either implementation are shared. */
+
+/* Same textual representation as uuid_out */
+static void append_uuid(StringInfo s, const pg_uuid_t *uuid)
+{
+  static const char hex_chars[] = "0123456789abcdef";
+  int i;
+
+  for(i=0; i<UUID_LEN; ++i) {
+    if(i == 4 || i == 6 || i == 8 || i == 10)
+      appendStringInfoChar(s, '-');
+    appendStringInfoChar(s, hex_chars[uuid->data[i] >> 4]);
+    appendStringInfoChar(s, hex_chars[uuid->data[i] & 0x0F]);
+  }
+}
+
+static int get_uuid_array(ArrayType *array, Datum **tokens, bool **nulls)
+{
+  int nb;
+  deconstruct_array(array, UUIDOID, UUID_LEN, false, 'c', tokens, nulls, &nb);
+  return nb;
+}
+
+/* As in the PL/pgSQL implementation, no gate is created for fewer than
+ * two tokens: an empty product is gate_one(), an empty sum
+ * gate_zero(), and a single token is returned as is */
+Datum provenance_times(PG_FUNCTION_ARGS)
+{
+  Datum *tokens;
+  bool *nulls;
+  int nb, i;
+  pg_uuid_t *result = (pg_uuid_t *) palloc(sizeof(pg_uuid_t));
+
+  if(PG_ARGISNULL(0))
+    PG_RETURN_NULL();
+
+  nb = get_uuid_array(PG_GETARG_ARRAYTYPE_P(0), &tokens, &nulls);
+
+  if(nb == 0) {
+    *result = *provsql_gate_one();
+  } else if(nb == 1) {
+    if(nulls[0])
+      PG_RETURN_NULL();
+    *result = *DatumGetUUIDP(tokens[0]);
+  } else {
+    /* Same computation as uuid_provsql_agg */
+    StringInfoData s;
+    pg_uuid_t state;
+
+    for(i=0; i<nb; ++i)
+      if(nulls[i])
+        elog(ERROR, "provenance_times: NULL provenance token");
+
+    state = *DatumGetUUIDP(tokens[0]);
+
+    initStringInfo(&s);
+    for(i=1; i<nb; ++i) {
+      resetStringInfo(&s);
+      append_uuid(&s, &state);
+      append_uuid(&s, DatumGetUUIDP(tokens[i]));
+      provsql_uuid_v5(s.data, s.len, &state);
+    }
+
+    resetStringInfo(&s);
+    appendStringInfoString(&s, "times");
+    append_uuid(&s, &state);
+    provsql_uuid_v5(s.data, s.len, result);
+
+    circuit_add_gate(result, gate_times);
+    for(i=0; i<nb; ++i)
+      circuit_add_wire(result, DatumGetUUIDP(tokens[i]), i+1);
+    circuit_flush_if_needed();
+  }
+
+  PG_RETURN_UUID_P(result);
+}
+
+Datum provenance_plus(PG_FUNCTION_ARGS)
+{
+  Datum *tokens;
+  bool *nulls;
+  int nb, i;
+  pg_uuid_t *result = (pg_uuid_t *) palloc(sizeof(pg_uuid_t));
+
+  nb = get_uuid_array(PG_GETARG_ARRAYTYPE_P(0), &tokens, &nulls);
+
+  if(nb == 0) {
+    *result = *provsql_gate_zero();
+  } else if(nb == 1) {
+    if(nulls[0])
+      PG_RETURN_NULL();
+    *result = *DatumGetUUIDP(tokens[0]);
+  } else {
+    /* Same computation as concat('plus',array_to_string(tokens, ',')),
+     * NULL tokens being ignored */
+    StringInfoData s;
+    bool first = true;
+
+    initStringInfo(&s);
+    appendStringInfoString(&s, "plus");
+    for(i=0; i<nb; ++i) {
+      if(nulls[i])
+        continue;
+      if(!first)
+        appendStringInfoChar(&s, ',');
+      append_uuid(&s, DatumGetUUIDP(tokens[i]));
+      first = false;
+    }
+    provsql_uuid_v5(s.data, s.len, result);
+
+    circuit_add_gate(result, gate_plus);
+    for(i=0; i<nb; ++i)
+      if(!nulls[i] && !provsql_uuid_equal(DatumGetUUIDP(tokens[i]), provsql_gate_zero()))
+        circuit_add_wire(result, DatumGetUUIDP(tokens[i]), 0);
+    circuit_flush_if_needed();
+  }
+
+  PG_RETURN_UUID_P(result);
+}
+
+Datum provenance_monus(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token1, *token2;
+  pg_uuid_t *result = (pg_uuid_t *) palloc(sizeof(pg_uuid_t));
+  pg_uuid_t monusl, monusr;
+  StringInfoData s;
+
+  if(PG_ARGISNULL(1)) {
+    /* Special semantics, because of a LEFT OUTER JOIN used by the
+     * difference operator: token2 NULL means there is no second argument */
+    if(PG_ARGISNULL(0))
+      PG_RETURN_NULL();
+    PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+  }
+
+  token2 = PG_GETARG_UUID_P(1);
+
+  if(PG_ARGISNULL(0)) {
+    if(provsql_uuid_equal(token2, provsql_gate_zero()))
+      PG_RETURN_NULL();
+    elog(ERROR, "provenance_monus: NULL provenance token");
+  }
+
+  token1 = PG_GETARG_UUID_P(0);
+
+  if(provsql_uuid_equal(token1, token2) || provsql_uuid_equal(token1, provsql_gate_zero())) {
+    // X-X=0, 0-X=0
+    *result = *provsql_gate_zero();
+    PG_RETURN_UUID_P(result);
+  } else if(provsql_uuid_equal(token2, provsql_gate_zero())) {
+    // X-0=X
+    PG_RETURN_UUID_P(token1);
+  }
+
+  initStringInfo(&s);
+
+  appendStringInfoString(&s, "monus");
+  append_uuid(&s, token1);
+  append_uuid(&s, token2);
+  provsql_uuid_v5(s.data, s.len, result);
+
+  resetStringInfo(&s);
+  appendStringInfoString(&s, "monusl");
+  append_uuid(&s, token1);
+  append_uuid(&s, token2);
+  provsql_uuid_v5(s.data, s.len, &monusl);
+
+  resetStringInfo(&s);
+  appendStringInfoString(&s, "monusr");
+  append_uuid(&s, token1);
+  append_uuid(&s, token2);
+  provsql_uuid_v5(s.data, s.len, &monusr);
+
+  circuit_add_gate(result, gate_monus);
+  circuit_add_gate(&monusl, gate_monusl);
+  circuit_add_gate(&monusr, gate_monusr);
+  circuit_add_wire(result, &monusl, 0);
+  circuit_add_wire(result, &monusr, 0);
+  circuit_add_wire(&monusl, token1, 0);
+  circuit_add_wire(&monusr, token2, 0);
+  circuit_flush_if_needed();
+
+  PG_RETURN_UUID_P(result);
+}
+
+Datum provenance_project(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+  pg_uuid_t *result = (pg_uuid_t *) palloc(sizeof(pg_uuid_t));
+  StringInfoData s;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "provenance_project: NULL provenance token");
+
+  token = PG_GETARG_UUID_P(0);
+
+  initStringInfo(&s);
+  append_uuid(&s, token);
+
+  if(PG_ARGISNULL(1)) {
+    provsql_uuid_v5(s.data, s.len, result);
+    circuit_add_gate(result, gate_project);
+    circuit_add_wire(result, token, 0);
+  } else {
+    ArrayType *positions = PG_GETARG_ARRAYTYPE_P(1);
+    Oid typoutput;
+    bool typisvarlena;
+    Datum *elems;
+    bool *nulls;
+    int nb, i;
+
+    /* Same computation as concat(token, positions) */
+    getTypeOutputInfo(INT4ARRAYOID, &typoutput, &typisvarlena);
+    appendStringInfoString(&s, OidOutputFunctionCall(typoutput, PointerGetDatum(positions)));
+    provsql_uuid_v5(s.data, s.len, result);
+
+    circuit_add_gate(result, gate_project);
+    circuit_add_wire(result, token, 0);
+
+    deconstruct_array(positions, INT4OID, sizeof(int32), true, 'i', &elems, &nulls, &nb);
+    for(i=0; i<nb; ++i) {
+      int info = nulls[i] ? 0 : DatumGetInt32(elems[i]);
+      circuit_add_extra(result, info, info == 0, i+1, false);
+    }
+  }
+
+  circuit_flush_if_needed();
+
+  PG_RETURN_UUID_P(result);
+}
+
+Datum provenance_eq(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+  pg_uuid_t *result = (pg_uuid_t *) palloc(sizeof(pg_uuid_t));
+  int pos1 = PG_ARGISNULL(1) ? 0 : PG_GETARG_INT32(1);
+  int pos2 = PG_ARGISNULL(2) ? 0 : PG_GETARG_INT32(2);
+  StringInfoData s;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "provenance_eq: NULL provenance token");
+
+  token = PG_GETARG_UUID_P(0);
+
+  /* Same computation as concat(token, pos1, pos2) */
+  initStringInfo(&s);
+  append_uuid(&s, token);
+  if(!PG_ARGISNULL(1))
+    appendStringInfo(&s, "%d", pos1);
+  if(!PG_ARGISNULL(2))
+    appendStringInfo(&s, "%d", pos2);
+  provsql_uuid_v5(s.data, s.len, result);
+
+  circuit_add_gate(result, gate_eq);
+  circuit_add_wire(result, token, 0);
+  circuit_add_extra(result, pos1, PG_ARGISNULL(1), pos2, PG_ARGISNULL(2));
+  circuit_flush_if_needed();
+
+  PG_RETURN_UUID_P(result);
+}
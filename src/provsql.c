@@ -8,6 +8,7 @@
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_operator.h"
 #include "catalog/pg_collation.h"
+#include "executor/executor.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/planner.h"
@@ -19,6 +20,7 @@
 #include "utils/guc.h"
 
 #include "provsql_utils.h"
+#include "circuit_storage.h"
 
 #if PG_VERSION_NUM < 90400
 #error "ProvSQL requires PostgreSQL version 9.4 or later"
@@ -29,6 +31,21 @@ PG_MODULE_MAGIC;
 bool provsql_shared_library_loaded = false;
 bool provsql_interrupted = false;
 bool provsql_where_provenance = false;
+int provsql_circuit_storage = CIRCUIT_STORAGE_TABLES;
+int provsql_max_shared_gates = 100000;
+int provsql_max_shared_wires = 400000;
+bool provsql_defer_gate_insertion = false;
+int provsql_gate_buffer_size = 10000;
+int provsql_circuit_cache_size = 16384;
+int provsql_probability_threads = 1;
+bool provsql_store_compiled_circuits = false;
+bool provsql_minimize_dnf = false;
+
+static const struct config_enum_entry circuit_storage_options[] = {
+  {"tables", CIRCUIT_STORAGE_TABLES, false},
+  {"shared_memory", CIRCUIT_STORAGE_SHARED_MEMORY, false},
+  {NULL, 0, false}
+};
 
 static const char *PROVSQL_COLUMN_NAME="provsql";
 
@@ -37,6 +54,7 @@ extern void _PG_fini(void);
 
 static planner_hook_type prev_planner = NULL;
 static post_parse_analyze_hook_type prev_post_parse_analyze = NULL;
+static ExecutorEnd_hook_type prev_ExecutorEnd = NULL;
 
 static Query *process_query(
     Query *q,
@@ -1051,6 +1069,18 @@ static void provsql_post_parse_analyze(
     prev_post_parse_analyze(pstate, q);
 }
 
+/* Gates whose insertion was deferred are written at the end of each
+ * statement */
+static void provsql_ExecutorEnd(QueryDesc *queryDesc)
+{
+  if(prev_ExecutorEnd)
+    prev_ExecutorEnd(queryDesc);
+  else
+    standard_ExecutorEnd(queryDesc);
+
+  circuit_flush();
+}
+
 void _PG_init(void)
 {
   DefineCustomBoolVariable("provsql.where_provenance",
@@ -1064,12 +1094,135 @@ void _PG_init(void)
                           NULL,
                           NULL); 
 
+  DefineCustomEnumVariable("provsql.circuit_storage",
+                          "Where ProvSQL stores provenance circuits.",
+                          "tables uses the provenance_circuit_* tables, shared_memory "
+                          "keeps the circuit in shared memory until the server stops.",
+                          &provsql_circuit_storage,
+                          CIRCUIT_STORAGE_TABLES,
+                          circuit_storage_options,
+                          PGC_POSTMASTER,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.max_shared_gates",
+                          "Maximum number of gates stored in shared memory.",
+                          "Only used when provsql.circuit_storage is shared_memory.",
+                          &provsql_max_shared_gates,
+                          100000,
+                          1,
+                          INT_MAX,
+                          PGC_POSTMASTER,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.max_shared_wires",
+                          "Maximum number of wires stored in shared memory.",
+                          "Only used when provsql.circuit_storage is shared_memory.",
+                          &provsql_max_shared_wires,
+                          400000,
+                          1,
+                          INT_MAX,
+                          PGC_POSTMASTER,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomBoolVariable("provsql.defer_gate_insertion",
+                          "Should ProvSQL buffer new gates until the end of the statement?",
+                          "1 writes new gates of the provenance circuit in batches, 0 "
+                          "writes them as soon as they are created.",
+                          &provsql_defer_gate_insertion,
+                          false,
+                          PGC_USERSET,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.gate_buffer_size",
+                          "Number of buffered gates that triggers a write.",
+                          "Only used when provsql.defer_gate_insertion is on.",
+                          &provsql_gate_buffer_size,
+                          10000,
+                          1,
+                          INT_MAX,
+                          PGC_USERSET,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.circuit_cache_size",
+                          "Maximum memory used by each backend to cache gates of the circuit.",
+                          "0 disables the cache. The cache requires provsql to be in "
+                          "shared_preload_libraries.",
+                          &provsql_circuit_cache_size,
+                          16384,
+                          0,
+                          MAX_KILOBYTES,
+                          PGC_USERSET,
+                          GUC_UNIT_KB,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.probability_threads",
+                          "Number of threads used for probability evaluation.",
+                          "Used by the monte-carlo and possible-worlds methods; monte-carlo "
+                          "results for a given seed only depend on the number of threads.",
+                          &provsql_probability_threads,
+                          1,
+                          1,
+                          1024,
+                          PGC_USERSET,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomBoolVariable("provsql.store_compiled_circuits",
+                          "Should d-DNNFs obtained by the compilation method be kept?",
+                          "1 stores them in the provsql_compiled directory of the data "
+                          "directory, and reuses them for circuits of the same structure; "
+                          "0 compiles circuits every time.",
+                          &provsql_store_compiled_circuits,
+                          false,
+                          PGC_SUSET,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomBoolVariable("provsql.minimize_dnf",
+                          "Should circuits in disjunctive normal form be minimized before probability evaluation?",
+                          "1 removes duplicate and subsumed clauses and reports the number "
+                          "of clauses removed, 0 leaves circuits as they are.",
+                          &provsql_minimize_dnf,
+                          false,
+                          PGC_USERSET,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  circuit_storage_init();
+
   prev_planner = planner_hook;
   prev_post_parse_analyze = post_parse_analyze_hook;
+  prev_ExecutorEnd = ExecutorEnd_hook;
 
   if(process_shared_preload_libraries_in_progress) {
     planner_hook = provsql_planner;
     post_parse_analyze_hook = provsql_post_parse_analyze;
+    ExecutorEnd_hook = provsql_ExecutorEnd;
+
+    circuit_storage_request();
 
     provsql_shared_library_loaded=true;
   }
@@ -1079,4 +1232,6 @@ void _PG_fini(void)
 {
   planner_hook = prev_planner;
   post_parse_analyze_hook = prev_post_parse_analyze;
+  ExecutorEnd_hook = prev_ExecutorEnd;
+  circuit_storage_unregister();
 }
@@ -7,6 +7,7 @@
 #include "utils/lsyscache.h"
 
 #include "provsql_utils.h"
+#include "sha1.h"
 
 static Oid GetFuncOid(char *s)
 {
@@ -152,3 +153,57 @@ Oid find_equality_operator(Oid ltypeId, Oid rtypeId)
   else
     return InvalidOid;
 }
+
+/* uuid_ns_provsql(), i.e.,
+ * uuid_generate_v5(uuid_ns_url(),'http://pierre.senellart.com/software/provsql/') */
+static const pg_uuid_t uuid_ns_provsql = {{
+  0x92, 0x0d, 0x4f, 0x02, 0x87, 0x18, 0x53, 0x19,
+  0x95, 0x32, 0xd4, 0xab, 0x83, 0xa6, 0x44, 0x89
+}};
+
+/* Same result as uuid_generate_v5(uuid_ns_provsql(), name) */
+void provsql_uuid_v5(const char *name, int len, pg_uuid_t *result)
+{
+  sha1_ctx ctx;
+  unsigned char digest[SHA1_DIGEST_LENGTH];
+
+  sha1_init(&ctx);
+  sha1_update(&ctx, uuid_ns_provsql.data, UUID_LEN);
+  sha1_update(&ctx, name, len);
+  sha1_final(&ctx, digest);
+
+  memcpy(result->data, digest, UUID_LEN);
+  result->data[6] = (result->data[6] & 0x0F) | 0x50;
+  result->data[8] = (result->data[8] & 0x3F) | 0x80;
+}
+
+const pg_uuid_t *provsql_gate_zero(void)
+{
+  static pg_uuid_t zero;
+  static bool initialized = false;
+
+  if(!initialized) {
+    provsql_uuid_v5("zero", 4, &zero);
+    initialized = true;
+  }
+
+  return &zero;
+}
+
+const pg_uuid_t *provsql_gate_one(void)
+{
+  static pg_uuid_t one;
+  static bool initialized = false;
+
+  if(!initialized) {
+    provsql_uuid_v5("one", 3, &one);
+    initialized = true;
+  }
+
+  return &one;
+}
+
+bool provsql_uuid_equal(const pg_uuid_t *u1, const pg_uuid_t *u2)
+{
+  return memcmp(u1->data, u2->data, UUID_LEN) == 0;
+}
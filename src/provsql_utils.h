@@ -1,8 +1,21 @@
 #ifndef PROVSQL_UTILS_H
 #define PROVSQL_UTILS_H
 
+#include "pg_config.h" // for PG_VERSION_NUM
 #include "postgres_ext.h"
 #include "nodes/pg_list.h"
+#include "utils/uuid.h"
+
+#if PG_VERSION_NUM < 100000
+/* In versions of PostgreSQL < 10, pg_uuid_t is declared to be an opaque
+ * struct pg_uuid_t in uuid.h, so we have to give the definition of
+ * struct pg_uuid_t; this problem is resolved in PostgreSQL 10 */
+#define UUID_LEN 16
+struct pg_uuid_t
+{
+  unsigned char data[UUID_LEN];
+};
+#endif /* PG_VERSION_NUM */
 
 typedef struct constants_t {
   Oid OID_SCHEMA_PROVSQL;
@@ -20,11 +33,30 @@ typedef struct constants_t {
   Oid OID_FUNCTION_PROVENANCE;
 } constants_t;
 
+typedef enum circuit_storage_mode {
+  CIRCUIT_STORAGE_TABLES,
+  CIRCUIT_STORAGE_SHARED_MEMORY
+} circuit_storage_mode;
+
 bool initialize_constants(constants_t *constants);
 Oid find_equality_operator(Oid ltypeId, Oid rtypeId);
 
+void provsql_uuid_v5(const char *name, int len, pg_uuid_t *result);
+const pg_uuid_t *provsql_gate_zero(void);
+const pg_uuid_t *provsql_gate_one(void);
+bool provsql_uuid_equal(const pg_uuid_t *u1, const pg_uuid_t *u2);
+
 extern bool provsql_shared_library_loaded;
 extern bool provsql_interrupted;
 extern bool provsql_where_provenance;
+extern int provsql_circuit_storage;
+extern int provsql_max_shared_gates;
+extern int provsql_max_shared_wires;
+extern bool provsql_defer_gate_insertion;
+extern int provsql_gate_buffer_size;
+extern int provsql_circuit_cache_size;
+extern int provsql_probability_threads;
+extern bool provsql_store_compiled_circuits;
+extern bool provsql_minimize_dnf;
 
 #endif /* PROVSQL_UTILS_H */
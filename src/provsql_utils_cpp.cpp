@@ -1,13 +1,21 @@
+extern "C" {
+#include "postgres.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/uuid.h"
+}
+
 #include "provsql_utils_cpp.h"
 #include "Circuit.h"
 
 using namespace std;
 
 /* copied with small changes from uuid.c */
-string UUIDDatum2string(Datum token)
+string UUID2string(const pg_uuid_t &token)
 {
-  pg_uuid_t *uuid = DatumGetUUIDP(token);
   static const char hex_chars[] = "0123456789abcdef";
   string result;
 
@@ -16,8 +24,8 @@ string UUIDDatum2string(Datum token)
     if (i == 4 || i == 6 || i == 8 || i == 10)
       result += '-';
 
-    int hi = uuid->data[i] >> 4;
-    int lo = uuid->data[i] & 0x0F;
+    int hi = token.data[i] >> 4;
+    int lo = token.data[i] & 0x0F;
 
     result+=hex_chars[hi];
     result+=hex_chars[lo];
@@ -25,3 +33,49 @@ string UUIDDatum2string(Datum token)
 
   return result;
 }
+
+unordered_map<pg_uuid_t, string> readMapping(Datum mapping, const vector<Datum> &tokens)
+{
+  unordered_map<pg_uuid_t, string> result;
+
+  if(tokens.empty())
+    return result;
+
+  constants_t constants;
+  if(!initialize_constants(&constants)) {
+    elog(ERROR, "Cannot find provsql schema");
+  }
+
+  Oid relid = DatumGetObjectId(mapping);
+  char *relname = get_rel_name(relid);
+  if(relname == NULL)
+    elog(ERROR, "Mapping table with OID %u does not exist", relid);
+
+  string query = string("SELECT provenance, value FROM ") +
+    quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), relname) +
+    " WHERE provenance = ANY($1)";
+
+  Datum arguments[1]={PointerGetDatum(construct_array(
+      const_cast<Datum *>(tokens.data()), tokens.size(), UUIDOID, UUID_LEN, false, 'c'))};
+  Oid argtypes[1]={constants.OID_TYPE_UUID_ARRAY};
+  char nulls[1] = {' '};
+
+  SPI_connect();
+
+  if(SPI_execute_with_args(query.c_str(), 1, argtypes, arguments, nulls, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "Cannot read mapping table %s", relname);
+
+  for(unsigned i = 0; i < SPI_processed; ++i) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    char *value = SPI_getvalue(tuple, SPI_tuptable->tupdesc, 2);
+    bool isnull;
+    Datum provenance = SPI_getbinval(tuple, SPI_tuptable->tupdesc, 1, &isnull);
+
+    if(value && !isnull)
+      result[*DatumGetUUIDP(provenance)] = value;
+  }
+
+  SPI_finish();
+
+  return result;
+}
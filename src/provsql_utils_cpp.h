@@ -3,10 +3,21 @@
 
 extern "C" {
 #include "postgres.h"
+#include "utils/uuid.h"
 }
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-std::string UUIDDatum2string(Datum token);
+#include "Circuit.h"
+
+std::string UUID2string(const pg_uuid_t &token);
+
+/* Values (as text) associated to tokens in a mapping table with a
+ * provenance and a value column; tokens absent from the mapping are
+ * absent from the result */
+std::unordered_map<pg_uuid_t, std::string> readMapping(
+    Datum mapping, const std::vector<Datum> &tokens);
 
 #endif
@@ -0,0 +1,116 @@
+/* Straightforward implementation of SHA-1 (RFC 3174), used to compute
+ * version 5 UUIDs for provenance tokens without going through the
+ * uuid-ossp extension */
+
+#include <string.h>
+
+#include "sha1.h"
+
+#define ROTL(x,n) (((x) << (n)) | ((x) >> (32-(n))))
+
+static void sha1_block(sha1_ctx *ctx, const unsigned char *block)
+{
+  uint32_t w[80];
+  uint32_t a, b, c, d, e;
+  int i;
+
+  for(i=0; i<16; ++i)
+    w[i] = ((uint32_t) block[4*i] << 24) | ((uint32_t) block[4*i+1] << 16) |
+           ((uint32_t) block[4*i+2] << 8) | (uint32_t) block[4*i+3];
+  for(i=16; i<80; ++i)
+    w[i] = ROTL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+  a=ctx->h[0]; b=ctx->h[1]; c=ctx->h[2]; d=ctx->h[3]; e=ctx->h[4];
+
+  for(i=0; i<80; ++i) {
+    uint32_t f, k, tmp;
+
+    if(i<20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if(i<40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if(i<60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+
+    tmp = ROTL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = ROTL(b, 30);
+    b = a;
+    a = tmp;
+  }
+
+  ctx->h[0]+=a; ctx->h[1]+=b; ctx->h[2]+=c; ctx->h[3]+=d; ctx->h[4]+=e;
+}
+
+void sha1_init(sha1_ctx *ctx)
+{
+  ctx->h[0]=0x67452301;
+  ctx->h[1]=0xEFCDAB89;
+  ctx->h[2]=0x98BADCFE;
+  ctx->h[3]=0x10325476;
+  ctx->h[4]=0xC3D2E1F0;
+  ctx->length=0;
+  ctx->buffered=0;
+}
+
+void sha1_update(sha1_ctx *ctx, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+
+  ctx->length += len;
+
+  if(ctx->buffered > 0) {
+    size_t n = 64 - ctx->buffered;
+    if(n > len)
+      n = len;
+    memcpy(ctx->buffer + ctx->buffered, p, n);
+    ctx->buffered += n;
+    p += n;
+    len -= n;
+    if(ctx->buffered < 64)
+      return;
+    sha1_block(ctx, ctx->buffer);
+    ctx->buffered = 0;
+  }
+
+  while(len >= 64) {
+    sha1_block(ctx, p);
+    p += 64;
+    len -= 64;
+  }
+
+  memcpy(ctx->buffer, p, len);
+  ctx->buffered = len;
+}
+
+void sha1_final(sha1_ctx *ctx, unsigned char digest[SHA1_DIGEST_LENGTH])
+{
+  uint64_t bits = ctx->length * 8;
+  unsigned char pad = 0x80;
+  unsigned char zero = 0;
+  unsigned char len[8];
+  int i;
+
+  sha1_update(ctx, &pad, 1);
+  while(ctx->buffered != 56)
+    sha1_update(ctx, &zero, 1);
+
+  for(i=0; i<8; ++i)
+    len[i] = (unsigned char) (bits >> (56 - 8*i));
+  sha1_update(ctx, len, 8);
+
+  for(i=0; i<5; ++i) {
+    digest[4*i] = (unsigned char) (ctx->h[i] >> 24);
+    digest[4*i+1] = (unsigned char) (ctx->h[i] >> 16);
+    digest[4*i+2] = (unsigned char) (ctx->h[i] >> 8);
+    digest[4*i+3] = (unsigned char) ctx->h[i];
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_DIGEST_LENGTH 20
+
+typedef struct sha1_ctx {
+  uint32_t h[5];
+  uint64_t length;
+  unsigned char buffer[64];
+  size_t buffered;
+} sha1_ctx;
+
+void sha1_init(sha1_ctx *ctx);
+void sha1_update(sha1_ctx *ctx, const void *data, size_t len);
+void sha1_final(sha1_ctx *ctx, unsigned char digest[SHA1_DIGEST_LENGTH]);
+
+#endif /* SHA1_H */
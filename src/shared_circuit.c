@@ -0,0 +1,230 @@
+#include "postgres.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+#include "shared_circuit.h"
+
+/* The hash table of gates is split into partitions, each protected by
+ * its own lock, so that backends creating different gates do not wait
+ * for each other; space in the wire and extra arrays is reserved
+ * atomically */
+#define NUM_PARTITIONS 16
+
+typedef struct shared_circuit_header {
+  LWLock *locks[NUM_PARTITIONS];
+  pg_atomic_uint32 nb_wires;
+  pg_atomic_uint32 nb_extra;
+} shared_circuit_header;
+
+typedef struct shared_gate {
+  pg_uuid_t token;      /* Hash key, must be first */
+  gate_type type;
+  uint32 nb_children;
+  uint32 children;      /* Position of the first child in wires */
+  uint32 nb_extra;
+  uint32 extra;         /* Position of the first pair in extra */
+} shared_gate;
+
+static shared_circuit_header *header = NULL;
+static HTAB *gates = NULL;
+static pg_uuid_t *wires = NULL;
+static int32 *extra = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Wires and extra information share the same bound, extra information
+ * being stored as pairs of integers */
+static Size wires_size(void)
+{
+  return MAXALIGN(mul_size(provsql_max_shared_wires, sizeof(pg_uuid_t)));
+}
+
+static Size extra_size(void)
+{
+  return MAXALIGN(mul_size(provsql_max_shared_wires, 2 * sizeof(int32)));
+}
+
+static Size arrays_size(void)
+{
+  return add_size(add_size(MAXALIGN(sizeof(shared_circuit_header)), wires_size()),
+                  extra_size());
+}
+
+static void shared_circuit_startup(void)
+{
+  bool found;
+  HASHCTL info;
+
+  if(prev_shmem_startup_hook)
+    prev_shmem_startup_hook();
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+  header = ShmemInitStruct("provsql shared circuit", arrays_size(), &found);
+  wires = (pg_uuid_t *) ((char *) header + MAXALIGN(sizeof(shared_circuit_header)));
+  extra = (int32 *) ((char *) wires + wires_size());
+
+  if(!found) {
+    int i;
+#if PG_VERSION_NUM >= 90600
+    LWLockPadded *tranche = GetNamedLWLockTranche("provsql");
+#endif
+
+    for(i=0; i<NUM_PARTITIONS; ++i)
+#if PG_VERSION_NUM >= 90600
+      header->locks[i] = &tranche[i].lock;
+#else
+      header->locks[i] = LWLockAssign();
+#endif
+    pg_atomic_init_u32(&header->nb_wires, 0);
+    pg_atomic_init_u32(&header->nb_extra, 0);
+  }
+
+  memset(&info, 0, sizeof(info));
+  info.keysize = sizeof(pg_uuid_t);
+  info.entrysize = sizeof(shared_gate);
+  info.num_partitions = NUM_PARTITIONS;
+  gates = ShmemInitHash("provsql shared circuit gates",
+                        provsql_max_shared_gates, provsql_max_shared_gates,
+                        &info, HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+
+  LWLockRelease(AddinShmemInitLock);
+}
+
+void shared_circuit_request(void)
+{
+  RequestAddinShmemSpace(add_size(arrays_size(),
+                                  hash_estimate_size(provsql_max_shared_gates,
+                                                     sizeof(shared_gate))));
+#if PG_VERSION_NUM >= 90600
+  RequestNamedLWLockTranche("provsql", NUM_PARTITIONS);
+#else
+  RequestAddinLWLocks(NUM_PARTITIONS);
+#endif
+
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = shared_circuit_startup;
+}
+
+void shared_circuit_unregister(void)
+{
+  if(shmem_startup_hook == shared_circuit_startup)
+    shmem_startup_hook = prev_shmem_startup_hook;
+}
+
+bool shared_circuit_available(void)
+{
+  return header != NULL;
+}
+
+/* Reserves nb consecutive slots in the wire or extra array, whose used
+ * size is counter; returns false if there is not enough room */
+static bool reserve(pg_atomic_uint32 *counter, unsigned nb, uint32 *position)
+{
+  uint32 current = pg_atomic_read_u32(counter);
+
+  do {
+    if((uint64) current + nb > (uint64) provsql_max_shared_wires)
+      return false;
+  } while(!pg_atomic_compare_exchange_u32(counter, &current, current + nb));
+
+  *position = current;
+  return true;
+}
+
+static LWLock *partition_lock(uint32 hashcode)
+{
+  return header->locks[hashcode % NUM_PARTITIONS];
+}
+
+bool shared_circuit_add_gate(const pg_uuid_t *token, gate_type type,
+                             unsigned nb_children, const pg_uuid_t *children,
+                             unsigned nb_extra, const int *extra_info)
+{
+  uint32 hashcode = get_hash_value(gates, token);
+  LWLock *lock = partition_lock(hashcode);
+  shared_gate *g;
+  bool found;
+  uint32 children_position, extra_position;
+
+  LWLockAcquire(lock, LW_EXCLUSIVE);
+
+  g = (shared_gate *) hash_search_with_hash_value(gates, token, hashcode,
+                                                  HASH_ENTER_NULL, &found);
+
+  if(g == NULL) {
+    LWLockRelease(lock);
+    ereport(ERROR,
+            (errcode(ERRCODE_OUT_OF_MEMORY),
+             errmsg("out of shared memory for the provenance circuit"),
+             errhint("You might need to increase provsql.max_shared_gates.")));
+  }
+
+  if(found) {
+    LWLockRelease(lock);
+    return false;
+  }
+
+  /* Space reserved for children is lost if there is no room left for
+   * extra information, but the store is then full anyway */
+  if(!reserve(&header->nb_wires, nb_children, &children_position) ||
+     !reserve(&header->nb_extra, nb_extra, &extra_position)) {
+    hash_search_with_hash_value(gates, token, hashcode, HASH_REMOVE, NULL);
+    LWLockRelease(lock);
+    ereport(ERROR,
+            (errcode(ERRCODE_OUT_OF_MEMORY),
+             errmsg("out of shared memory for the provenance circuit"),
+             errhint("You might need to increase provsql.max_shared_wires.")));
+  }
+
+  g->type = type;
+
+  g->nb_children = nb_children;
+  g->children = children_position;
+  memcpy(wires + children_position, children, nb_children * sizeof(pg_uuid_t));
+
+  g->nb_extra = nb_extra;
+  g->extra = extra_position;
+  memcpy(extra + 2 * extra_position, extra_info, 2 * nb_extra * sizeof(int32));
+
+  LWLockRelease(lock);
+
+  return true;
+}
+
+bool shared_circuit_get_gate(const pg_uuid_t *token, gate_type *type,
+                             unsigned *nb_children, pg_uuid_t **children,
+                             unsigned *nb_extra, int **extra_info)
+{
+  uint32 hashcode = get_hash_value(gates, token);
+  LWLock *lock = partition_lock(hashcode);
+  shared_gate *g;
+
+  LWLockAcquire(lock, LW_SHARED);
+
+  g = (shared_gate *) hash_search_with_hash_value(gates, token, hashcode,
+                                                  HASH_FIND, NULL);
+
+  if(g == NULL) {
+    LWLockRelease(lock);
+    return false;
+  }
+
+  *type = g->type;
+
+  *nb_children = g->nb_children;
+  *children = (pg_uuid_t *) palloc((g->nb_children + 1) * sizeof(pg_uuid_t));
+  memcpy(*children, wires + g->children, g->nb_children * sizeof(pg_uuid_t));
+
+  *nb_extra = g->nb_extra;
+  *extra_info = (int *) palloc((2 * g->nb_extra + 1) * sizeof(int));
+  memcpy(*extra_info, extra + 2 * g->extra, 2 * g->nb_extra * sizeof(int32));
+
+  LWLockRelease(lock);
+
+  return true;
+}
@@ -0,0 +1,34 @@
+#ifndef SHARED_CIRCUIT_H
+#define SHARED_CIRCUIT_H
+
+#include "circuit_storage.h"
+
+/* Storage of the provenance circuit in shared memory, used instead of
+ * the provenance_circuit_* tables when provsql.circuit_storage is set
+ * to shared_memory. Gates are stored in a shared hash table indexed by
+ * their token, children and extra information in append-only arrays.
+ * Input gates are not stored: any token that is not known is an input
+ * gate. The content of the shared memory is lost when the server
+ * stops. */
+
+/* To be called from _PG_init, while shared_preload_libraries are being
+ * processed */
+void shared_circuit_request(void);
+void shared_circuit_unregister(void);
+
+bool shared_circuit_available(void);
+
+/* Adds a gate with its children and nb_extra pairs of extra
+ * information; returns false if the gate already existed, in which
+ * case nothing is changed */
+bool shared_circuit_add_gate(const pg_uuid_t *token, gate_type type,
+                             unsigned nb_children, const pg_uuid_t *children,
+                             unsigned nb_extra, const int *extra);
+
+/* Returns false if the gate is not in shared memory; otherwise,
+ * children and extra are palloc'd copies */
+bool shared_circuit_get_gate(const pg_uuid_t *token, gate_type *type,
+                             unsigned *nb_children, pg_uuid_t **children,
+                             unsigned *nb_extra, int **extra);
+
+#endif /* SHARED_CIRCUIT_H */
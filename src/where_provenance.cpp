@@ -8,13 +8,13 @@ extern "C" {
 #include "utils/builtins.h"
 
 #include "provsql_utils.h"
+#include "circuit_storage.h"
   
   PG_FUNCTION_INFO_V1(where_provenance);
 }
 
 #include <algorithm>
 #include <utility>
-#include <regex>
 #include <sstream>
 
 #include "WhereCircuit.h"
@@ -22,104 +22,90 @@ extern "C" {
 
 using namespace std;
 
-static vector<pair<int,int>> parse_array(string s)
-{
-  s=s.substr(1,s.size()-2); // Remove initial '{' and final '}'
-
-  vector<pair<int,int>> result;
-  regex reg("},?");
-
-  sregex_token_iterator iter(s.begin(), s.end(), reg, -1);
-  sregex_token_iterator end;
-
-  for(sregex_token_iterator iter(s.begin(), s.end(), reg, -1), end; iter!=end; ++iter) {
-    string p = *iter;
-    int k=p.find(",",1);
-    string s1=p.substr(1,k-1);
-    int i1;
-    if(s1=="NULL")
-      i1=0;
-    else
-      i1=stoi(p.substr(1,k-1));
-    int i2=stoi(p.substr(k+1,p.size()-k));
-    result.push_back(make_pair(i1,i2));
-  }
-
-  return result;
-}
-
-static string where_provenance_internal
-  (Datum token)
+/* Reads the sub-circuit rooted at token, whatever the storage of the
+ * circuit */
+static void load_circuit(WhereCircuit &c, Datum token)
 {
   constants_t constants;
   if(!initialize_constants(&constants)) {
     elog(ERROR, "Cannot find provsql schema");
   }
 
-  Datum arguments[1]={token};
-  Oid argtypes[1]={constants.OID_TYPE_PROVENANCE_TOKEN};
-  char nulls[1] = {' '};
-  
-  SPI_connect();
-
-  WhereCircuit c;
-
-  if(SPI_execute_with_args(
-      "SELECT * FROM provsql.sub_circuit_for_where($1)", 2, argtypes, arguments, nulls, true, 0)
-      == SPI_OK_SELECT) {
-    int proc = SPI_processed;
-    TupleDesc tupdesc = SPI_tuptable->tupdesc;
-    SPITupleTable *tuptable = SPI_tuptable;
-
-    for (int i = 0; i < proc; i++)
-    {
-      HeapTuple tuple = tuptable->vals[i];
-
-      string f = SPI_getvalue(tuple, tupdesc, 1);
-      string type = SPI_getvalue(tuple, tupdesc, 3);
-      if(type == "input") {
-        string table = SPI_getvalue(tuple, tupdesc, 4);
-        int nb_columns = stoi(SPI_getvalue(tuple, tupdesc, 5));
-
-        c.setGateInput(f, table, nb_columns);
-      } else {
-        unsigned id=c.getGate(f);
-
-        if(type == "times") {
-          c.setGate(f, WhereGate::TIMES);
-        } else if(type == "plus") {
-          c.setGate(f, WhereGate::PLUS);
-        } else if(type == "project" || type == "eq") {
-          vector<pair<int,int>> v = parse_array(SPI_getvalue(tuple, tupdesc, 6));
-          if(type=="eq") {
-            if(v.size()!=1)
-              elog(ERROR, "Incorrect extra information on eq gate");
-            c.setGateEquality(f, v[0].first, v[0].second);
-          } else {
-            sort(v.begin(), v.end(), [](auto &left, auto &right) {
-                return left.second < right.second;
-                });
-            vector<int> infos;
-            for(auto p : v) {
-              infos.push_back(p.first);
-            }
-            c.setGateProjection(f, move(infos));
+  unsigned nb_gates;
+  circuit_gate *gates = circuit_sub_circuit(DatumGetUUIDP(token), &nb_gates);
+
+  for(unsigned i=0; i<nb_gates; ++i) {
+    const pg_uuid_t &f = gates[i].token;
+    vector<pair<int,int>> v;
+    unsigned id;
+
+    for(unsigned j=0; j<gates[i].nb_extra; ++j)
+      v.push_back(make_pair(gates[i].extra[2*j], gates[i].extra[2*j+1]));
+
+    switch(gates[i].type) {
+      case gate_input:
+        {
+          Datum arguments[1]={UUIDPGetDatum(&gates[i].token)};
+          Oid argtypes[1]={constants.OID_TYPE_PROVENANCE_TOKEN};
+          char nulls[1] = {' '};
+
+          SPI_connect();
+          if(SPI_execute_with_args(
+              "SELECT table_name, nb_columns FROM provsql.identify_token($1)",
+              1, argtypes, arguments, nulls, true, 0) != SPI_OK_SELECT)
+            elog(ERROR, "SPI_execute_with_args failed on provsql.identify_token");
+
+          char *table = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+          if(table == NULL)
+            elog(ERROR, "Cannot identify the table of token %s", UUID2string(f).c_str());
+          c.setGateInput(f, table, stoi(SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2)));
+          SPI_finish();
+        }
+        continue;
+      case gate_times:
+        id = c.setGate(f, WhereGate::TIMES);
+        break;
+      case gate_plus:
+        id = c.setGate(f, WhereGate::PLUS);
+        break;
+      case gate_eq:
+        if(v.size()!=1)
+          elog(ERROR, "Incorrect extra information on eq gate");
+        id = c.setGateEquality(f, v[0].first, v[0].second);
+        break;
+      case gate_project:
+        {
+          sort(v.begin(), v.end(), [](auto &left, auto &right) {
+              return left.second < right.second;
+              });
+          vector<int> infos;
+          for(auto p : v) {
+            infos.push_back(p.first);
           }
-        } else if(type == "monusr" || type == "monusl" || type == "monus") {
-          elog(ERROR, "Where-provenance of non-monotone query not supported");
-        } else {
-          elog(ERROR, "Wrong type of gate in circuit");
+          id = c.setGateProjection(f, move(infos));
         }
-        c.addWire(id, c.getGate(SPI_getvalue(tuple, tupdesc, 2)));
-      }
+        break;
+      case gate_monus:
+      case gate_monusl:
+      case gate_monusr:
+        elog(ERROR, "Where-provenance of non-monotone query not supported");
+      default:
+        elog(ERROR, "Wrong type of gate in circuit");
     }
-  } else {
-    elog(ERROR, "SPI_execute_with_args failed on provsql.sub_circuit_for_where");
+
+    for(unsigned j=0; j<gates[i].nb_children; ++j)
+      c.addWire(id, c.getGate(gates[i].children[j]));
   }
+}
+
+static string where_provenance_internal
+  (Datum token)
+{
+  WhereCircuit c;
 
-  SPI_finish();
+  load_circuit(c, token);
   
-  unsigned gate = c.getGate(UUIDDatum2string(token));
+  unsigned gate = c.getGate(*DatumGetUUIDP(token));
 
   vector<set<WhereCircuit::Locator>> v = c.evaluate(gate);
 
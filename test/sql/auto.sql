@@ -0,0 +1,34 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE auto_result AS
+SELECT city, probability_evaluate(provenance(),'p','auto') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t
+ORDER BY CITY;
+
+SELECT remove_provenance('auto_result');
+
+SELECT city, ROUND(prob::numeric,2) AS prob FROM auto_result;
+DROP TABLE auto_result;
+
+CREATE TABLE auto_stats AS
+SELECT city, (circuit_stats(provenance(),'p')).*
+FROM (
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT remove_provenance('auto_stats');
+
+SELECT city, inputs, depth, dnf, method FROM auto_stats ORDER BY city;
+DROP TABLE auto_stats;
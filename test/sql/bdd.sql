@@ -0,0 +1,31 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE bdd_result AS
+SELECT city, probability_evaluate(provenance(),'p','bdd') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t
+ORDER BY CITY;
+
+SELECT remove_provenance('bdd_result');
+
+SELECT city, ROUND(prob::numeric,2) AS prob FROM bdd_result;
+DROP TABLE bdd_result;
+
+SELECT probability_evaluate(provenance(),'p','bdd','1')
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
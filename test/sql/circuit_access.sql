@@ -0,0 +1,41 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+SELECT get_gate_type(gate_zero()) AS zero, get_gate_type(gate_one()) AS one;
+
+SELECT provenance_times(VARIADIC ARRAY[]::uuid[]) = gate_one() AS empty_times,
+       provenance_plus(ARRAY[]::uuid[]) = gate_zero() AS empty_plus,
+       provenance_times(gate_zero()) = gate_zero() AS single_times,
+       provenance_plus(ARRAY[gate_one()]) = gate_one() AS single_plus;
+
+CREATE TABLE circuit_access_result AS
+  SELECT city,
+    get_gate_type(provenance()) AS type,
+    array_length(get_children(provenance()),1) AS nb_children
+  FROM personnel
+  GROUP BY city;
+
+SELECT remove_provenance('circuit_access_result');
+SELECT * FROM circuit_access_result ORDER BY city;
+DROP TABLE circuit_access_result;
+
+CREATE TABLE circuit_access_result AS
+  SELECT city, provenance() AS token FROM personnel GROUP BY city;
+
+SELECT remove_provenance('circuit_access_result');
+SELECT city, gate_type, count(*)
+FROM circuit_access_result, sub_circuit(token)
+GROUP BY city, gate_type
+ORDER BY city, gate_type;
+
+SELECT city, gate_type, count(*), count(desc_str) AS described
+FROM circuit_access_result, sub_circuit_with_desc(token, 'personnel_name')
+GROUP BY city, gate_type
+ORDER BY city, gate_type;
+DROP TABLE circuit_access_result;
+
+SELECT lanname FROM pg_proc JOIN pg_language ON prolang=pg_language.oid
+WHERE pg_proc.oid='provsql.sub_circuit'::regproc;
+
+SELECT has_function_privilege('public', 'provsql.invalidate_circuit_cache()', 'EXECUTE')
+  AS public_invalidate;
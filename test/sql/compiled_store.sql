@@ -0,0 +1,48 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+SELECT create_provenance_mapping('p_half', 'personnel', '0.5');
+
+SET provsql.store_compiled_circuits = on;
+
+-- The d-DNNFs compiled for these circuits are kept in the data directory
+CREATE TABLE compiled_store_result AS
+SELECT city,
+       probability_evaluate(provenance(),'p','compilation','internal') AS prob,
+       probability_evaluate(provenance(),'p_half','compilation','internal') AS prob_half
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+-- Compiler names are checked before being used in file names
+SELECT probability_evaluate(provenance(),'p','compilation','../internal')
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+RESET provsql.store_compiled_circuits;
+
+SELECT count(*) > 0 AS stored
+FROM pg_ls_dir('provsql_compiled') AS f
+WHERE f LIKE 'internal-%';
+
+SELECT remove_provenance('compiled_store_result');
+
+SELECT city, ROUND(prob::numeric,2) AS prob, ROUND(prob_half::numeric,3) AS prob_half
+FROM compiled_store_result
+ORDER BY city;
+
+DROP TABLE compiled_store_result;
+DROP TABLE p_half;
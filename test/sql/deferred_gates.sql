@@ -0,0 +1,50 @@
+\set ECHO none
+SET search_path TO public,provsql;
+SET provsql.defer_gate_insertion = on;
+
+/* Gates are buffered, and a small buffer forces intermediate flushes
+ * while the query runs */
+SET provsql.gate_buffer_size = 2;
+
+CREATE TABLE deferred_result AS
+  SELECT *, formula(provenance(),'personnel_name')
+  FROM (
+    SELECT DISTINCT classification FROM personnel
+  ) t;
+
+SELECT remove_provenance('deferred_result');
+SELECT * FROM deferred_result ORDER BY classification;
+DROP TABLE deferred_result;
+
+/* Gates buffered by a previous statement can be read back */
+SET provsql.gate_buffer_size = 10000;
+
+CREATE TABLE deferred_result AS
+  SELECT city, provenance() AS token FROM personnel GROUP BY city;
+
+SELECT remove_provenance('deferred_result');
+SELECT city, get_gate_type(token), array_length(get_children(token),1)
+FROM deferred_result
+ORDER BY city;
+DROP TABLE deferred_result;
+
+/* Buffered gates are inserted with the rights of the owner of provsql,
+ * not of the role running the query */
+CREATE ROLE regress_provsql_deferred;
+GRANT SELECT ON personnel TO regress_provsql_deferred;
+SET ROLE regress_provsql_deferred;
+
+CREATE TEMP TABLE deferred_result AS
+  SELECT city, provenance() AS token FROM personnel GROUP BY city;
+
+SELECT remove_provenance('deferred_result');
+RESET ROLE;
+SELECT city, get_gate_type(token)
+FROM deferred_result
+ORDER BY city;
+DROP TABLE deferred_result;
+REVOKE SELECT ON personnel FROM regress_provsql_deferred;
+DROP ROLE regress_provsql_deferred;
+
+RESET provsql.gate_buffer_size;
+RESET provsql.defer_gate_insertion;
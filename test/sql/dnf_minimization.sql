@@ -0,0 +1,25 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE dnf_minimization_result AS
+SELECT city, provenance() AS token
+FROM (
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT remove_provenance('dnf_minimization_result');
+
+-- Pairs of a person with itself subsume all other pairs of the same
+-- city: the n² clauses of a city of n persons are reduced to n
+SET provsql.minimize_dnf = on;
+SELECT city, ROUND(b.probability::numeric,2) AS prob
+FROM probability_evaluate_batch(
+  (SELECT array_agg(token) FROM dnf_minimization_result), 'p', 'possible-worlds') b
+  JOIN dnf_minimization_result r ON r.token=b.token
+ORDER BY city;
+RESET provsql.minimize_dnf;
+
+DROP TABLE dnf_minimization_result;
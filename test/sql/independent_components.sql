@@ -0,0 +1,29 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE except_result AS
+SELECT DISTINCT city
+FROM personnel
+EXCEPT 
+SELECT p1.city
+FROM personnel p1,personnel p2
+WHERE p1.id<p2.id AND p1.city=p2.city
+GROUP BY p1.city;
+
+-- The provenance of each pair is the conjunction of two circuits with
+-- no input in common, evaluated separately
+CREATE TABLE components_result AS
+SELECT t1.city AS city1, t2.city AS city2,
+       probability_evaluate(provenance(),'p','possible-worlds') AS pw,
+       probability_evaluate(provenance(),'p','compilation','internal') AS internal
+FROM except_result t1, except_result t2
+WHERE t1.city<t2.city;
+
+SELECT remove_provenance('components_result');
+
+SELECT city1, city2, ROUND(pw::numeric,2) AS pw, ROUND(internal::numeric,2) AS internal
+FROM components_result
+ORDER BY city1, city2;
+
+DROP TABLE components_result;
+DROP TABLE except_result;
@@ -0,0 +1,30 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE kl_result AS
+SELECT city, probability_evaluate(provenance(),'p','karp-luby','0.01;0.01;42') AS prob
+FROM (
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT remove_provenance('kl_result');
+
+SELECT city, ABS(prob - CASE city WHEN 'Berlin' THEN 0.28 WHEN 'New York' THEN 0.02 ELSE 0.45 END) < 0.01 AS correct
+FROM kl_result
+ORDER BY city;
+
+DROP TABLE kl_result;
+
+SELECT probability_evaluate(provenance(),'p','karp-luby','0.01;0.01')
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
@@ -17,3 +17,41 @@ SELECT remove_provenance('mc_result');
 
 SELECT city, ROUND(prob::numeric,1) FROM mc_result WHERE city = 'Paris';
 DROP TABLE mc_result;
+
+SET client_min_messages = warning;
+CREATE TABLE mc_result AS
+SELECT city, probability_evaluate(provenance(),'p','monte-carlo-adaptive','0.02;0.05;42') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+RESET client_min_messages;
+
+SELECT remove_provenance('mc_result');
+
+SELECT city, ROUND(prob::numeric,1) FROM mc_result WHERE city = 'Paris';
+DROP TABLE mc_result;
+
+-- A contradictory circuit, of probability 0, stops at the sample limit
+CREATE TABLE mc_result AS
+SELECT city, probability_evaluate(provenance(),'p','monte-carlo-adaptive','0.1;0.05;42') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+  WHERE city = 'Paris'
+EXCEPT 
+  SELECT city
+  FROM personnel
+  WHERE city = 'Paris'
+  GROUP BY city
+) t;
+
+SELECT remove_provenance('mc_result');
+
+SELECT city, ROUND(prob::numeric,2) FROM mc_result;
+DROP TABLE mc_result;
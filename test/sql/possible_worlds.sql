@@ -17,4 +17,26 @@ ORDER BY city;
 SELECT remove_provenance('pw_result');
 
 SELECT city, ROUND(prob::numeric,2) AS prob FROM pw_result;
+
+SET provsql.probability_threads = 3;
+CREATE TABLE pw_result_threads AS
+SELECT city, probability_evaluate(provenance(),'p','possible-worlds') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+RESET provsql.probability_threads;
+
+SELECT remove_provenance('pw_result_threads');
+
+SELECT city, ABS(t.prob - r.prob) < 1e-9 AS same
+FROM pw_result_threads t JOIN pw_result r USING (city)
+ORDER BY city;
+DROP TABLE pw_result_threads;
+
 DROP TABLE pw_result;
@@ -0,0 +1,59 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE batch_result AS
+SELECT city, provenance() AS token
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT remove_provenance('batch_result');
+
+SELECT city, ROUND(b.probability::numeric,2) AS prob
+FROM probability_evaluate_batch(
+  (SELECT array_agg(token) FROM batch_result), 'p', 'possible-worlds') b
+  JOIN batch_result r ON r.token=b.token
+ORDER BY city;
+
+SELECT city, ROUND(b.probability::numeric,1) AS prob
+FROM probability_evaluate_batch(
+  (SELECT array_agg(token) FROM batch_result), 'p', 'monte-carlo', '10000') b
+  JOIN batch_result r ON r.token=b.token
+WHERE city = 'Paris';
+
+SET provsql.probability_threads = 4;
+SELECT bool_and(b1.probability = b2.probability) AS reproducible
+FROM probability_evaluate_batch(
+  (SELECT array_agg(token) FROM batch_result), 'p', 'monte-carlo', '10000;42') b1
+  JOIN probability_evaluate_batch(
+  (SELECT array_agg(token) FROM batch_result), 'p', 'monte-carlo', '10000;42') b2
+  ON b1.token=b2.token;
+RESET provsql.probability_threads;
+
+-- Read-once tokens listed before tokens that are not read-once
+CREATE TABLE batch_distinct AS
+SELECT city, provenance() AS token
+FROM (SELECT DISTINCT city FROM personnel) t;
+
+SELECT remove_provenance('batch_distinct');
+
+CREATE TABLE batch_mixed AS
+  SELECT 'distinct' AS kind, city, token FROM batch_distinct
+UNION ALL
+  SELECT 'except' AS kind, city, token FROM batch_result;
+
+SELECT kind, city, ROUND(b.probability::numeric,2) AS prob
+FROM probability_evaluate_batch(
+  (SELECT array_agg(token ORDER BY kind, city) FROM batch_mixed), 'p', 'possible-worlds') b
+  JOIN batch_mixed r ON r.token=b.token
+ORDER BY kind, city;
+
+DROP TABLE batch_mixed;
+DROP TABLE batch_distinct;
+DROP TABLE batch_result;
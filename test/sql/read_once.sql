@@ -0,0 +1,32 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+-- A single sample suffices, since the circuits are read-once
+CREATE TABLE read_once_result AS
+SELECT city, probability_evaluate(provenance(),'p','monte-carlo','1') AS prob
+FROM (SELECT DISTINCT city FROM personnel) t;
+
+SELECT remove_provenance('read_once_result');
+
+SELECT city, ROUND(prob::numeric,2) AS prob FROM read_once_result ORDER BY city;
+
+DROP TABLE read_once_result;
+
+-- Read-once circuit on more inputs than input signatures can separate
+CREATE TABLE read_once_large AS
+SELECT i, 1 AS grp, 0.01::DOUBLE PRECISION AS probability
+FROM generate_series(1,120) i;
+SELECT add_provenance('read_once_large');
+SELECT create_provenance_mapping('p_large', 'read_once_large', 'probability');
+
+CREATE TABLE read_once_result AS
+SELECT grp, probability_evaluate(provenance(),'p_large','monte-carlo','1') AS prob
+FROM (SELECT DISTINCT grp FROM read_once_large) t;
+
+SELECT remove_provenance('read_once_result');
+
+SELECT grp, ROUND(prob::numeric,4) AS prob FROM read_once_result;
+
+DROP TABLE read_once_result;
+DROP TABLE p_large;
+DROP TABLE read_once_large;
@@ -0,0 +1,25 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+SELECT create_provenance_mapping('p_certain', 'personnel', '1');
+
+-- With certain inputs, the negation in the circuit is folded away, so
+-- that karp-luby, which does not accept negations, can be used
+CREATE TABLE simplification_result AS
+SELECT city, probability_evaluate(provenance(),'p_certain','karp-luby','0.01;0.01') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT remove_provenance('simplification_result');
+
+SELECT city, prob FROM simplification_result ORDER BY city;
+
+DROP TABLE simplification_result;
+DROP TABLE p_certain;
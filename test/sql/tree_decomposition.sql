@@ -0,0 +1,42 @@
+\set ECHO none
+SET search_path TO public, provsql;
+
+CREATE TABLE tree_decomposition_result AS
+SELECT city, probability_evaluate(provenance(),'p','tree-decomposition') AS prob
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t
+ORDER BY CITY;
+
+SELECT remove_provenance('tree_decomposition_result');
+
+SELECT city, ROUND(prob::numeric,2) AS prob FROM tree_decomposition_result;
+DROP TABLE tree_decomposition_result;
+
+SELECT probability_evaluate(provenance(),'p','tree-decomposition','0')
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;
+
+SELECT probability_evaluate(provenance(),'p','tree-decomposition','31')
+FROM (
+  SELECT DISTINCT city
+  FROM personnel
+EXCEPT 
+  SELECT p1.city
+  FROM personnel p1,personnel p2
+  WHERE p1.id<p2.id AND p1.city=p2.city
+  GROUP BY p1.city
+) t;